@@ -0,0 +1,261 @@
+#include "BracketIndex.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "proto.h"
+
+BracketIndex::BracketIndex(const char *opening, const char *closing)
+: opening(opening),
+  closing(closing),
+  both(std::string(opening) + closing)
+{
+	bytewise = (this->opening.size() == 1 && this->closing.size() == 1 &&
+	            (!using_utf8() || ((unsigned char)*opening < 0x80 && (unsigned char)*closing < 0x80)));
+}
+
+/* Return whether this index is of the given pair of brackets. */
+bool BracketIndex::is_for(const char *opening, const char *closing) const
+{
+	return (this->opening == opening && this->closing == closing);
+}
+
+/* Forget what is known about the lines numbered lineno and up, since
+ * they have changed or are about to be renumbered. */
+void BracketIndex::forget_from(ssize_t lineno)
+{
+	size_t keep = (lineno <= 1) ? 0 : (lineno - 1) / LINE_INDEX_STRIDE;
+
+	if (chunks.size() > keep) {
+		chunks.resize(keep);
+		chunk_known.resize(keep);
+	}
+
+	keep /= LINE_INDEX_STRIDE;
+
+	if (blocks.size() > keep) {
+		blocks.resize(keep);
+		block_known.resize(keep);
+	}
+}
+
+/* Return the depth change over first followed by second. */
+BracketIndex::depth BracketIndex::joined(const depth& first, const depth& second)
+{
+	return depth{first.net + second.net, std::min(first.low, first.net + second.low)};
+}
+
+/* Return whether the bracket at p is the opening one. */
+bool BracketIndex::is_opening(const char *p) const
+{
+	return (strncmp(p, opening.c_str(), opening.size()) == 0);
+}
+
+/* Return the first bracket at or after s, or NULL if there is none. */
+const char *BracketIndex::next_bracket(const char *s) const
+{
+	return (bytewise ? strpbrk(s, both.c_str()) : mbstrpbrk(s, both.c_str()));
+}
+
+/* Return the last bracket in text that comes before index before, or NULL
+ * if there is none. */
+const char *BracketIndex::prev_bracket(const char *text, size_t before) const
+{
+	if (before == 0) {
+		return NULL;
+	}
+
+	if (bytewise) {
+		return revstrpbrk(text, both.c_str(), text + before - 1);
+	}
+
+	return mbrevstrpbrk(text, both.c_str(), text + move_mbleft(text, before));
+}
+
+/* Return the depth change over the line text. */
+BracketIndex::depth BracketIndex::line_depth(const char *text) const
+{
+	depth result = {0, 0};
+
+	for (const char *p = next_bracket(text); p != NULL; p = next_bracket(p + (bytewise ? 1 : move_mbright(p, 0)))) {
+		if (is_opening(p)) {
+			result.net++;
+		} else if (--result.net < result.low) {
+			result.low = result.net;
+		}
+	}
+
+	return result;
+}
+
+/* Return the depth change over the given stretch of lines, working it
+ * out first if that hasn't been done. */
+BracketIndex::depth BracketIndex::chunk_depth(size_t chunk)
+{
+	if (chunk < chunks.size() && chunk_known[chunk]) {
+		return chunks[chunk];
+	}
+
+	depth result = {0, 0};
+	const filestruct *fileptr = line_from_number(chunk * LINE_INDEX_STRIDE + 1);
+
+	for (size_t i = 0; i < LINE_INDEX_STRIDE && fileptr != NULL; i++) {
+		result = joined(result, line_depth(fileptr->data));
+		fileptr = next_line(fileptr);
+	}
+
+	if (chunks.size() <= chunk) {
+		chunks.resize(chunk + 1);
+		chunk_known.resize(chunk + 1, false);
+	}
+	chunks[chunk] = result;
+	chunk_known[chunk] = true;
+
+	return result;
+}
+
+/* Put the depth change over the given stretch of stretches in found, if
+ * it is known or all of its stretches are.  Return whether it was. */
+bool BracketIndex::block_depth(size_t block, depth *found)
+{
+	if (block < blocks.size() && block_known[block]) {
+		*found = blocks[block];
+		return true;
+	}
+
+	size_t first = block * LINE_INDEX_STRIDE;
+	depth result = {0, 0};
+
+	if (chunks.size() < first + LINE_INDEX_STRIDE) {
+		return false;
+	}
+
+	for (size_t chunk = first; chunk < first + LINE_INDEX_STRIDE; chunk++) {
+		if (!chunk_known[chunk]) {
+			return false;
+		}
+		result = joined(result, chunks[chunk]);
+	}
+
+	if (blocks.size() <= block) {
+		blocks.resize(block + 1);
+		block_known.resize(block + 1, false);
+	}
+	blocks[block] = result;
+	block_known[block] = true;
+
+	*found = result;
+	return true;
+}
+
+/* Go through the brackets from from on, counting opening ones up and
+ * closing ones down, and return the one where count gets to zero, or
+ * NULL if it doesn't. */
+const char *BracketIndex::scan_forward(const char *from, ssize_t *count) const
+{
+	for (const char *p = next_bracket(from); p != NULL; p = next_bracket(p + (bytewise ? 1 : move_mbright(p, 0)))) {
+		*count += is_opening(p) ? 1 : -1;
+		if (*count == 0) {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* Go back through the brackets in text before index before, counting
+ * closing ones up and opening ones down, and return the one where count
+ * gets to zero, or NULL if it doesn't. */
+const char *BracketIndex::scan_backward(const char *text, size_t before, ssize_t *count) const
+{
+	for (const char *p = prev_bracket(text, before); p != NULL; p = prev_bracket(text, p - text)) {
+		*count += is_opening(p) ? -1 : 1;
+		if (*count == 0) {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* Find the bracket that matches the one at (line, x), going forwards if
+ * that one opens a level and backwards if it closes one, and put where it
+ * is in line and x.  Stretches of lines where the depth never gets back
+ * to where it was are passed over whole.  Return whether there is such
+ * a bracket. */
+bool BracketIndex::find_match(filestruct **line, size_t *x, bool reverse)
+{
+	const size_t stride = LINE_INDEX_STRIDE, block_lines = stride * stride;
+	filestruct *fileptr = *line;
+	ssize_t lineno = fileptr->lineno, last = openfile->filebot->lineno;
+	ssize_t count = 1;
+	const char *found;
+	depth d;
+
+	if (reverse) {
+		found = scan_backward(fileptr->data, *x, &count);
+
+		while (found == NULL && --lineno >= 1) {
+			/* At the last line of a stretch, see whether the match can
+			 * be in the stretch at all, going by the bracket depth. */
+			if (lineno % stride == 0) {
+				size_t chunk = lineno / stride - 1;
+
+				if (lineno % block_lines == 0 && block_depth(lineno / block_lines - 1, &d) && count > d.net - d.low) {
+					count -= d.net;
+					lineno -= block_lines - 1;
+					fileptr = NULL;
+					continue;
+				}
+
+				d = chunk_depth(chunk);
+				if (count > d.net - d.low) {
+					count -= d.net;
+					lineno -= stride - 1;
+					fileptr = NULL;
+					continue;
+				}
+			}
+
+			fileptr = (fileptr != NULL && fileptr->lineno == lineno + 1) ? fileptr->prev : line_from_number(lineno);
+			found = scan_backward(fileptr->data, strlen(fileptr->data), &count);
+		}
+	} else {
+		found = scan_forward(fileptr->data + move_mbright(fileptr->data, *x), &count);
+
+		while (found == NULL && ++lineno <= last) {
+			/* At the first line of a stretch, likewise. */
+			if ((lineno - 1) % stride == 0) {
+				size_t chunk = (lineno - 1) / stride;
+
+				if ((lineno - 1) % block_lines == 0 && lineno + (ssize_t)block_lines - 1 <= last &&
+				        block_depth(chunk / stride, &d) && count + d.low > 0) {
+					count += d.net;
+					lineno += block_lines - 1;
+					fileptr = NULL;
+					continue;
+				}
+
+				d = chunk_depth(chunk);
+				if (count + d.low > 0) {
+					count += d.net;
+					lineno += stride - 1;
+					fileptr = NULL;
+					continue;
+				}
+			}
+
+			fileptr = (fileptr != NULL && fileptr->lineno == lineno - 1) ? fileptr->next : line_from_number(lineno);
+			found = scan_forward(fileptr->data, &count);
+		}
+	}
+
+	if (found == NULL) {
+		return false;
+	}
+
+	*line = fileptr;
+	*x = found - fileptr->data;
+
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "types.h"
+
+/* Keeps, for one pair of brackets, how the bracket depth changes over
+ * each stretch of LINE_INDEX_STRIDE lines of the current buffer, and over
+ * each stretch of LINE_INDEX_STRIDE of those, so that looking for the
+ * bracket that matches another one can pass over whole stretches without
+ * a match at once.  The stretches are worked out when they're first
+ * needed, and forgotten from a line on when that line changes. */
+class BracketIndex
+{
+	public:
+		BracketIndex(const char *opening, const char *closing);
+
+		bool is_for(const char *opening, const char *closing) const;
+		void forget_from(ssize_t lineno);
+		bool find_match(filestruct **line, size_t *x, bool reverse);
+
+	private:
+		struct depth {
+			ssize_t net;
+			/* How much deeper the text leaves us. */
+			ssize_t low;
+			/* The least depth reached on the way, zero at most. */
+		};
+
+		static depth joined(const depth& first, const depth& second);
+
+		bool is_opening(const char *p) const;
+		const char *next_bracket(const char *s) const;
+		const char *prev_bracket(const char *text, size_t before) const;
+		depth line_depth(const char *text) const;
+		depth chunk_depth(size_t chunk);
+		bool block_depth(size_t block, depth *found);
+		const char *scan_forward(const char *from, ssize_t *count) const;
+		const char *scan_backward(const char *text, size_t before, ssize_t *count) const;
+
+		std::string opening, closing;
+		/* The brackets that open and close a level. */
+
+		std::string both;
+		/* The two of them together, to look for either. */
+
+		bool bytewise;
+		/* Whether both brackets are single bytes that can't be part of
+		 * another character, so that the text can be scanned bytewise. */
+
+		std::vector<depth> chunks;
+		std::vector<bool> chunk_known;
+		/* The depth change over each stretch of lines, and whether it
+		 * has been worked out yet. */
+
+		std::vector<depth> blocks;
+		std::vector<bool> block_known;
+		/* The same for each stretch of stretches. */
+};
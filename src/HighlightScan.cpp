@@ -0,0 +1,94 @@
+#include "HighlightScan.h"
+
+#include <signal.h>
+
+#include "proto.h"
+
+HighlightScan::HighlightScan(const filestruct *fileage, const ColorList& colors)
+: fileage(fileage),
+  colors(colors),
+  total((size_t)-1),
+  finished(0),
+  cancelled(false),
+  copied(false)
+{
+	/* Our signal handlers jump back into the main loop, so the worker
+	 * must never be the one to run them. */
+	sigset_t all_signals, old_signals;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+	worker = std::thread(&HighlightScan::run, this);
+
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+}
+
+HighlightScan::~HighlightScan()
+{
+	cancelled = true;
+	worker.join();
+}
+
+/* Wait until the worker has copied the lines of the buffer, so that they
+ * can be changed. */
+void HighlightScan::wait_for_copy()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	copy_done.wait(guard, [this] { return copied; });
+}
+
+/* Return how many lines, from the first on, have been worked out.  Their
+ * results can be read without further ado. */
+size_t HighlightScan::done() const
+{
+	return finished.load(std::memory_order_acquire);
+}
+
+/* Return how many lines there are to work out, or (size_t)-1 while the
+ * lines are still being copied. */
+size_t HighlightScan::size() const
+{
+	return total.load(std::memory_order_acquire);
+}
+
+const unsigned char *HighlightScan::state(size_t index) const
+{
+	return &states[index * colors.size()];
+}
+
+size_t HighlightScan::len(size_t index) const
+{
+	return sums[index].first;
+}
+
+size_t HighlightScan::hash(size_t index) const
+{
+	return sums[index].second;
+}
+
+void HighlightScan::run()
+{
+	size_t ncolors = colors.size();
+
+	for (const filestruct *fileptr = fileage; fileptr != NULL && !cancelled; fileptr = next_line(fileptr)) {
+		lines.push_back(fileptr->data);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		copied = true;
+	}
+	copy_done.notify_all();
+
+	states.resize(lines.size() * ncolors);
+	sums.resize(lines.size());
+	total.store(lines.size(), std::memory_order_release);
+
+	for (size_t i = 0; i < lines.size() && !cancelled; i++) {
+		sums[i].second = text_hash(lines[i].c_str(), &sums[i].first);
+		multi_state(lines[i].c_str(), sums[i].first, colors, (i > 0) ? &states[(i - 1) * ncolors] : NULL, &states[i * ncolors]);
+
+		finished.store(i + 1, std::memory_order_release);
+	}
+}
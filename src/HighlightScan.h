@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+/* Works out, on a thread of its own, which multi-line regexes are open at
+ * the start and at the end of every line of a copy of a buffer, so that
+ * opening a big file doesn't have to wait for it.  The copy is made on
+ * that thread too; until it is done, the lines must not be changed. */
+class HighlightScan
+{
+	public:
+		HighlightScan(const filestruct *fileage, const ColorList& colors);
+		virtual ~HighlightScan();
+
+		void wait_for_copy();
+		size_t done() const;
+		size_t size() const;
+		const unsigned char *state(size_t index) const;
+		size_t len(size_t index) const;
+		size_t hash(size_t index) const;
+
+	private:
+		void run();
+
+		const filestruct *fileage;
+		/* The first of the lines to copy. */
+
+		std::vector<std::string> lines;
+		/* The text of the lines, as it was when the scan started. */
+
+		ColorList colors;
+		/* The colors that the lines are highlighted with. */
+
+		std::vector<unsigned char> states;
+		/* For each line, the state of each color, as in linecolors. */
+
+		std::vector<std::pair<size_t, size_t> > sums;
+		/* For each line, its length and the hash of its text. */
+
+		std::atomic<size_t> total;
+		/* How many lines there are, once they have been copied. */
+
+		std::atomic<size_t> finished;
+		/* How many lines, from the first on, have been worked out. */
+
+		std::atomic<bool> cancelled;
+		/* Whether the scan should stop early. */
+
+		bool copied;
+		/* Whether the worker is done with the lines of the buffer. */
+
+		std::mutex lock;
+		std::condition_variable copy_done;
+		/* Guard copied, and tell of its change. */
+
+		std::thread worker;
+};
@@ -1,5 +1,7 @@
 #include "Keyboard.h"
 
+#include <poll.h>
+
 Keyboard::Keyboard()
 {
 	termkey = termkey_new(0, TERMKEY_FLAG_NOTERMIOS|TERMKEY_FLAG_CONVERTKP);
@@ -9,11 +11,26 @@ Keyboard::Keyboard()
 
 bool Keyboard::has_input() const
 {
-	return (termkey->buffcount > 0);
+	return (!held_keys.empty() || termkey->buffcount > 0);
+}
+
+/* Wait at most timeout milliseconds for input, and return whether there
+ * is some. */
+bool Keyboard::wait_for_input(int timeout) const
+{
+	struct pollfd input = { termkey_get_fd(termkey), POLLIN, 0 };
+
+	return (has_input() || poll(&input, 1, timeout) > 0);
 }
 
 Key Keyboard::get_key()
 {
+	if (!held_keys.empty()) {
+		Key key = held_keys.front();
+		held_keys.pop_front();
+		return key;
+	}
+
 	TermKeyKey key;
 	if (termkey_waitkey(termkey, &key) != TERMKEY_RES_KEY) {
 		throw "Error reading keyboard input!";
@@ -21,6 +38,14 @@ Key Keyboard::get_key()
 	return Key(termkey, key);
 }
 
+/* Give back a key that was read too early, so that the next call to
+ * get_key() returns it again.  Keys given back are read in the order
+ * they were given back. */
+void Keyboard::put_back(const Key& key)
+{
+	held_keys.push_back(key);
+}
+
 Key::Key(TermKey* termkey, TermKeyKey key)
 : termkey(termkey), key(key)
 {
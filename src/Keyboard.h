@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <string>
 
 // include ncurses for ESCDELAY
@@ -34,7 +35,11 @@ class Keyboard
 		Keyboard();
 
 		bool has_input() const;
+		bool wait_for_input(int timeout) const;
 		Key get_key();
+		void put_back(const Key& key);
 	private:
 		TermKey *termkey;
+		std::deque<Key> held_keys;
+		/* Keys that were read and given back, to be read again first. */
 };
@@ -0,0 +1,78 @@
+#include "LineWriter.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "proto.h"
+
+LineWriter::LineWriter(FILE *f, FileFormat fmt)
+: f(f),
+  fmt(fmt),
+  block(WRITE_BLOCK_SIZE),
+  used(0),
+  written(0)
+{
+}
+
+/* Add len bytes of line text, writing out the block as often as it fills
+ * up.  Return false if a write failed. */
+bool LineWriter::add_line(const char *text, size_t len)
+{
+	while (len > 0) {
+		if (used == block.size() && !flush()) {
+			return false;
+		}
+
+		size_t part = std::min(len, block.size() - used);
+		char *to = &block[used];
+
+		memcpy(to, text, part);
+		for (char *nl = (char *)memchr(to, '\n', part); nl != NULL; nl = (char *)memchr(nl + 1, '\n', to + part - nl - 1)) {
+			*nl = '\0';
+		}
+
+		used += part;
+		text += part;
+		len -= part;
+	}
+
+	return true;
+}
+
+/* Add the line ending of our file format.  Return false if a write
+ * failed. */
+bool LineWriter::add_ending()
+{
+	if (block.size() - used < 2 && !flush()) {
+		return false;
+	}
+
+	if (fmt == DOS_FILE || fmt == MAC_FILE) {
+		block[used++] = '\r';
+	}
+	if (fmt != MAC_FILE) {
+		block[used++] = '\n';
+	}
+
+	return true;
+}
+
+/* Write out what the block holds.  Return false if not all of it could
+ * be written. */
+bool LineWriter::flush()
+{
+	size_t done = fwrite(block.data(), sizeof(char), used, f);
+
+	written += done;
+	if (done < used) {
+		return false;
+	}
+
+	used = 0;
+	return true;
+}
+
+size_t LineWriter::bytes_written() const
+{
+	return written;
+}
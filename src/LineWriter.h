@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include <stdio.h>
+
+#include "types.h"
+
+/* Gathers lines, the way they are to appear on disk, in one large block
+ * and writes the block out whenever it fills up, so that saving a buffer
+ * takes a few large writes rather than several small ones per line.  The
+ * newlines that stand for nulls in a line are turned back into nulls as
+ * the line is copied, so that the line itself is left alone. */
+class LineWriter
+{
+	public:
+		LineWriter(FILE *f, FileFormat fmt);
+
+		bool add_line(const char *text, size_t len);
+		bool add_ending();
+		bool flush();
+		size_t bytes_written() const;
+
+	private:
+		FILE *f;
+		/* The stream we write to. */
+
+		FileFormat fmt;
+		/* Which line endings we write. */
+
+		std::vector<char> block;
+		/* Where the lines are gathered. */
+
+		size_t used;
+		/* How much of the block holds text that hasn't been written. */
+
+		size_t written;
+		/* How many bytes have been written so far. */
+};
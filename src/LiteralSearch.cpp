@@ -0,0 +1,361 @@
+#include "LiteralSearch.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "proto.h"
+
+/* Invalid bytes in UTF-8 text are compared as themselves, but never
+ * match a valid character; this bit, which no character has, keeps the
+ * two apart. */
+#define INVALID_BYTE 0x40000000
+
+LiteralSearch::LiteralSearch(const char *needle, bool case_sensitive)
+: needle(needle),
+  case_sensitive(case_sensitive),
+  bytewise(case_sensitive || !using_utf8()),
+  ascii_needle(true),
+  two_variants(false)
+{
+	/* Work out which bytes stand for one another.  In UTF-8 text only
+	 * ASCII can be matched a byte at a time, so only that is grouped. */
+	for (int c = 0; c < 256; c++) {
+		fold[c] = c;
+
+		if (case_sensitive || (!bytewise && c > 0x7F)) {
+			continue;
+		}
+
+		for (int d = 0; d < c; d++) {
+			if (bytewise ? tolower(d) == tolower(c) : towlower(d) == towlower(c)) {
+				fold[c] = fold[d];
+				break;
+			}
+		}
+	}
+
+	for (const char *p = needle; *p != '\0'; p++) {
+		if ((unsigned char)*p > 0x7F) {
+			ascii_needle = false;
+		}
+		folded += fold[(unsigned char)*p];
+	}
+
+	size_t m = folded.size();
+
+	for (int c = 0; c < 256; c++) {
+		shift[c] = rshift[c] = m;
+	}
+	for (size_t i = 0; i + 1 < m; i++) {
+		shift[(unsigned char)folded[i]] = m - 1 - i;
+		rshift[(unsigned char)folded[m - 1 - i]] = m - 1 - i;
+	}
+
+	if (m > 0) {
+		int firsts = 0, lasts = 0;
+
+		for (int c = 0; c < 256; c++) {
+			if (fold[c] == (unsigned char)folded[0] && firsts++ < 2) {
+				first[firsts - 1] = c;
+			}
+			if (fold[c] == (unsigned char)folded[m - 1] && lasts++ < 2) {
+				last[lasts - 1] = c;
+			}
+		}
+
+		if (firsts == 1) {
+			first[1] = first[0];
+		}
+		if (lasts == 1) {
+			last[1] = last[0];
+		}
+
+		two_variants = (firsts <= 2 && lasts <= 2);
+	}
+
+	if (!bytewise) {
+		for (int c = 0; c < 0x80; c++) {
+			lower_ascii[c] = towlower(c);
+		}
+
+		for (const char *p = needle; *p != '\0';) {
+			int len;
+
+			wide.push_back(fold_mbchar(p, &len));
+			p += len;
+		}
+
+		size_t n = wide.size();
+
+		for (int c = 0; c < 256; c++) {
+			wide_shift[c] = wide_rshift[c] = n;
+		}
+		for (size_t i = 0; i + 1 < n; i++) {
+			wide_shift[wide[i] & 0xFF] = n - 1 - i;
+			wide_rshift[wide[n - 1 - i] & 0xFF] = n - 1 - i;
+		}
+	}
+}
+
+/* Return whether this search was prepared for the given needle. */
+bool LiteralSearch::is_for(const char *needle, bool case_sensitive) const
+{
+	return (this->case_sensitive == case_sensitive && this->needle == needle);
+}
+
+/* Return the first match at or after start, or NULL if there is none.
+ * Like strstr(), an empty needle matches straight away. */
+const char *LiteralSearch::find(const char *start) const
+{
+	/* The C library's own strstr() is already as quick as it gets. */
+	if (case_sensitive) {
+		return strstr(start, needle.c_str());
+	}
+
+	size_t len = strlen(start);
+
+	if (needle.empty()) {
+		return start;
+	}
+
+	if (bytewise || (ascii_needle && ascii_only(start, len))) {
+		return find_bytes(start, len);
+	}
+
+	return find_wide(start);
+}
+
+/* Return the last match that begins at or before rev_start in haystack,
+ * or NULL if there is none.  Like revstrstr(), an empty needle matches
+ * at rev_start itself. */
+const char *LiteralSearch::rfind(const char *haystack, const char *rev_start) const
+{
+	size_t len = strlen(haystack);
+
+	if (needle.empty()) {
+		return rev_start;
+	}
+
+	if (bytewise || (ascii_needle && ascii_only(haystack, len))) {
+		return rfind_bytes(haystack, len, rev_start - haystack);
+	}
+
+	return rfind_wide(haystack, rev_start - haystack);
+}
+
+/* Return whether the folded needle matches, bytewise, at text. */
+bool LiteralSearch::matches_at(const unsigned char *text) const
+{
+	for (size_t i = 0; i < folded.size(); i++) {
+		if (fold[text[i]] != (unsigned char)folded[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Look for the needle, a byte at a time, in the len bytes at start.
+ * With SSE2 we first pick out, sixteen places at a time, where both the
+ * first and the last byte of the needle fit, and only check the rest
+ * there; whatever remains is done with Boyer-Moore-Horspool. */
+const char *LiteralSearch::find_bytes(const char *start, size_t len) const
+{
+	const unsigned char *text = (const unsigned char *)start;
+	size_t m = folded.size(), pos = 0;
+
+#ifdef __SSE2__
+	if (two_variants) {
+		const __m128i first0 = _mm_set1_epi8(first[0]), first1 = _mm_set1_epi8(first[1]);
+		const __m128i last0 = _mm_set1_epi8(last[0]), last1 = _mm_set1_epi8(last[1]);
+
+		for (; pos + m + 15 <= len; pos += 16) {
+			__m128i head = _mm_loadu_si128((const __m128i *)(text + pos));
+			__m128i tail = _mm_loadu_si128((const __m128i *)(text + pos + m - 1));
+			int candidates = _mm_movemask_epi8(_mm_and_si128(
+			                     _mm_or_si128(_mm_cmpeq_epi8(head, first0), _mm_cmpeq_epi8(head, first1)),
+			                     _mm_or_si128(_mm_cmpeq_epi8(tail, last0), _mm_cmpeq_epi8(tail, last1))));
+
+			for (; candidates != 0; candidates &= candidates - 1) {
+				size_t at = pos + __builtin_ctz(candidates);
+
+				if (matches_at(text + at)) {
+					return start + at;
+				}
+			}
+		}
+	}
+#endif
+
+	while (pos + m <= len) {
+		unsigned char c = fold[text[pos + m - 1]];
+
+		if (c == (unsigned char)folded[m - 1] && matches_at(text + pos)) {
+			return start + pos;
+		}
+
+		pos += shift[c];
+	}
+
+	return NULL;
+}
+
+/* Look backwards for the needle, a byte at a time, in the len bytes at
+ * haystack, for a match that begins no later than index from.  This is
+ * find_bytes() in a mirror: sixteen offsets at a time with SSE2, and
+ * Horspool keyed on the first byte under the needle for the rest. */
+const char *LiteralSearch::rfind_bytes(const char *haystack, size_t len, size_t from) const
+{
+	const unsigned char *text = (const unsigned char *)haystack;
+	size_t m = folded.size();
+
+	if (len < m) {
+		return NULL;
+	}
+
+	/* One past the last place where a match could begin. */
+	size_t end = std::min(from, len - m) + 1;
+
+#ifdef __SSE2__
+	if (two_variants) {
+		const __m128i first0 = _mm_set1_epi8(first[0]), first1 = _mm_set1_epi8(first[1]);
+		const __m128i last0 = _mm_set1_epi8(last[0]), last1 = _mm_set1_epi8(last[1]);
+
+		for (; end >= 16; end -= 16) {
+			__m128i head = _mm_loadu_si128((const __m128i *)(text + end - 16));
+			__m128i tail = _mm_loadu_si128((const __m128i *)(text + end - 16 + m - 1));
+			int candidates = _mm_movemask_epi8(_mm_and_si128(
+			                     _mm_or_si128(_mm_cmpeq_epi8(head, first0), _mm_cmpeq_epi8(head, first1)),
+			                     _mm_or_si128(_mm_cmpeq_epi8(tail, last0), _mm_cmpeq_epi8(tail, last1))));
+
+			while (candidates != 0) {
+				int bit = 31 - __builtin_clz(candidates);
+				size_t at = end - 16 + bit;
+
+				if (matches_at(text + at)) {
+					return haystack + at;
+				}
+
+				candidates &= ~(1 << bit);
+			}
+		}
+	}
+#endif
+
+	while (end > 0) {
+		size_t pos = end - 1;
+		unsigned char c = fold[text[pos]];
+
+		if (c == (unsigned char)folded[0] && matches_at(text + pos)) {
+			return haystack + pos;
+		}
+
+		end = (rshift[c] < end) ? end - rshift[c] : 0;
+	}
+
+	return NULL;
+}
+
+/* Look for the needle in UTF-8 text, comparing folded characters the
+ * way mbstrncasecmp() does, with Boyer-Moore-Horspool over the line
+ * turned into wide characters once. */
+const char *LiteralSearch::find_wide(const char *start) const
+{
+	std::vector<wchar_t> text;
+	std::vector<size_t> offsets;
+	size_t m = wide.size(), pos = 0;
+
+	fold_mbstring(start, text, offsets);
+
+	while (pos + m <= text.size()) {
+		wchar_t c = text[pos + m - 1];
+
+		if (c == wide[m - 1] && std::equal(wide.begin(), wide.end() - 1, text.begin() + pos)) {
+			return start + offsets[pos];
+		}
+
+		pos += wide_shift[c & 0xFF];
+	}
+
+	return NULL;
+}
+
+/* Look backwards in UTF-8 text for a match that begins no later than
+ * index from, as rfind_bytes() does but over folded wide characters. */
+const char *LiteralSearch::rfind_wide(const char *haystack, size_t from) const
+{
+	std::vector<wchar_t> text;
+	std::vector<size_t> offsets;
+	size_t m = wide.size();
+
+	fold_mbstring(haystack, text, offsets);
+
+	if (text.size() < m) {
+		return NULL;
+	}
+
+	/* One past the last character where a match could begin. */
+	size_t end = std::upper_bound(offsets.begin(), offsets.end(), from) - offsets.begin();
+
+	end = std::min(end, text.size() - m + 1);
+
+	while (end > 0) {
+		size_t pos = end - 1;
+		wchar_t c = text[pos];
+
+		if (c == wide[0] && std::equal(wide.begin() + 1, wide.end(), text.begin() + pos + 1)) {
+			return haystack + offsets[pos];
+		}
+
+		end = (wide_rshift[c & 0xFF] < end) ? end - wide_rshift[c & 0xFF] : 0;
+	}
+
+	return NULL;
+}
+
+/* Turn the UTF-8 string s into folded wide characters, and note where in
+ * s each of them begins. */
+void LiteralSearch::fold_mbstring(const char *s, std::vector<wchar_t>& text, std::vector<size_t>& offsets) const
+{
+	text.reserve(strlen(s));
+	offsets.reserve(text.capacity());
+
+	for (const char *p = s; *p != '\0';) {
+		int len;
+
+		offsets.push_back(p - s);
+		text.push_back(fold_mbchar(p, &len));
+		p += len;
+	}
+}
+
+/* Return the lowercase form of the character at s, marked if s does not
+ * hold a valid character, and put its length in len.  The conversion
+ * state is our own, so searches can run on several threads at once. */
+wchar_t LiteralSearch::fold_mbchar(const char *s, int *len) const
+{
+	mbstate_t state;
+	wchar_t wc;
+
+	if ((unsigned char)*s < 0x80) {
+		*len = 1;
+		return lower_ascii[(unsigned char)*s];
+	}
+
+	memset(&state, 0, sizeof(state));
+	*len = mbrtowc(&wc, s, MB_CUR_MAX, &state);
+
+	if (*len <= 0) {
+		*len = 1;
+		return towlower((unsigned char)*s) | INVALID_BYTE;
+	}
+
+	return towlower(wc);
+}
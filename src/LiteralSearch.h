@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <wchar.h>
+
+/* Finds a plain string in lines of text, forwards or backwards, either
+ * exactly or ignoring case the way mbstrncasecmp() does.  The needle is
+ * prepared once, so that searching line after line for the same string
+ * doesn't have to look at it again. */
+class LiteralSearch
+{
+	public:
+		LiteralSearch(const char *needle, bool case_sensitive);
+
+		bool is_for(const char *needle, bool case_sensitive) const;
+		const char *find(const char *start) const;
+		const char *rfind(const char *haystack, const char *rev_start) const;
+
+	private:
+		bool matches_at(const unsigned char *text) const;
+		const char *find_bytes(const char *start, size_t len) const;
+		const char *find_wide(const char *start) const;
+		const char *rfind_bytes(const char *haystack, size_t len, size_t from) const;
+		const char *rfind_wide(const char *haystack, size_t from) const;
+		void fold_mbstring(const char *s, std::vector<wchar_t>& text, std::vector<size_t>& offsets) const;
+		wchar_t fold_mbchar(const char *s, int *len) const;
+
+		std::string needle;
+		/* The string we look for, as given. */
+
+		bool case_sensitive;
+		/* Whether case matters. */
+
+		bool bytewise;
+		/* Whether the needle can be matched one byte at a time against
+		 * any haystack; if not, only against pure ASCII ones. */
+
+		bool ascii_needle;
+		/* Whether the needle is all ASCII, with each of its characters
+		 * folding to another ASCII character. */
+
+		unsigned char fold[256];
+		/* For each byte, a stand-in shared by all bytes that are equal
+		 * to it when matching bytewise. */
+
+		std::string folded;
+		/* The needle with each byte replaced by its stand-in. */
+
+		size_t shift[256];
+		/* How far the needle may move on when the haystack byte under
+		 * its last byte has the given stand-in. */
+
+		size_t rshift[256];
+		/* The same for moving back, going by the byte under its first. */
+
+		unsigned char first[2], last[2];
+		/* The bytes that may open and close a match, when there are at
+		 * most two of each; used for the quick SSE2 scan. */
+
+		bool two_variants;
+		/* Whether first and last cover all possibilities. */
+
+		std::vector<wchar_t> wide;
+		/* The needle as folded wide characters, for UTF-8 text. */
+
+		size_t wide_shift[256], wide_rshift[256];
+		/* As shift and rshift, but by the low byte of a wide character. */
+
+		wchar_t lower_ascii[0x80];
+		/* The lowercase form of each ASCII character. */
+};
@@ -0,0 +1,220 @@
+#include "MatchIndex.h"
+
+#include <algorithm>
+#include <signal.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "proto.h"
+
+MatchIndex::MatchIndex(const filestruct *fileage, const char *needle, bool regexp, bool case_sensitive)
+: fileage(fileage),
+  needle(needle),
+  regexp(regexp),
+  case_sensitive(case_sensitive),
+  utf8(using_utf8()),
+  changes(text_changes),
+  usable(true),
+  literal(needle, case_sensitive),
+  finished(false),
+  cancelled(false),
+  copied(false)
+{
+	/* Compile the regex the same way as the search does, but for this
+	 * thread alone, since regexec() serializes calls that share one. */
+	if (regexp && regcomp(&compiled, needle, REG_EXTENDED | (case_sensitive ? 0 : REG_ICASE)) != 0) {
+		usable = false;
+		finished = true;
+		copied = true;
+		return;
+	}
+
+	/* As with HighlightScan, the signal handlers must stay on the main
+	 * thread. */
+	sigset_t all_signals, old_signals;
+	sigfillset(&all_signals);
+	pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+	worker = std::thread(&MatchIndex::run, this);
+
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+}
+
+MatchIndex::~MatchIndex()
+{
+	cancelled = true;
+	if (worker.joinable()) {
+		worker.join();
+	}
+
+	if (regexp && usable) {
+		regfree(&compiled);
+	}
+}
+
+/* Wait until the worker has copied the lines of the buffer, so that they
+ * can be changed. */
+void MatchIndex::wait_for_copy()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	copy_done.wait(guard, [this] { return copied; });
+}
+
+/* Return whether this index is of matches for the given needle. */
+bool MatchIndex::is_for(const char *needle, bool regexp, bool case_sensitive) const
+{
+	return (usable && this->regexp == regexp && this->case_sensitive == case_sensitive && this->needle == needle);
+}
+
+/* Return whether the text hasn't changed since the index was begun. */
+bool MatchIndex::is_current() const
+{
+	return (changes == text_changes);
+}
+
+/* Return whether all lines have been gone through.  Until then, none of
+ * the results may be read. */
+bool MatchIndex::complete() const
+{
+	return finished.load(std::memory_order_acquire);
+}
+
+/* Return a new index of the same needle, for the text as it is now. */
+MatchIndex *MatchIndex::renewed(const filestruct *fileage) const
+{
+	return new MatchIndex(fileage, needle.c_str(), regexp, case_sensitive);
+}
+
+size_t MatchIndex::count() const
+{
+	return matches.size();
+}
+
+/* Return the number, counting from one, of the match that begins at
+ * position x of the given line, or zero if none does. */
+size_t MatchIndex::number_of(ssize_t lineno, size_t x) const
+{
+	auto found = std::lower_bound(matches.begin(), matches.end(), std::make_pair(lineno, x), [](const match& m, const std::pair<ssize_t, size_t>& at) {
+		return (m.lineno < at.first || (m.lineno == at.first && m.x < at.second));
+	});
+
+	if (found == matches.end() || found->lineno != lineno || found->x != x) {
+		return 0;
+	}
+
+	return found - matches.begin() + 1;
+}
+
+/* Return the first line, going from line from towards line to, either
+ * up or down, that holds a match, or to if none does. */
+ssize_t MatchIndex::line_with_match(ssize_t from, ssize_t to) const
+{
+	if (from <= to) {
+		size_t n = first_on_line(from);
+
+		return (n < matches.size() && matches[n].lineno <= to) ? matches[n].lineno : to;
+	} else {
+		size_t n = first_on_line(from + 1);
+
+		return (n > 0 && matches[n - 1].lineno >= to) ? matches[n - 1].lineno : to;
+	}
+}
+
+/* Return the index of the first match on the given line or after it. */
+size_t MatchIndex::first_on_line(ssize_t lineno) const
+{
+	return std::lower_bound(matches.begin(), matches.end(), lineno, [](const match& m, ssize_t line) {
+		return m.lineno < line;
+	}) - matches.begin();
+}
+
+ssize_t MatchIndex::line(size_t n) const
+{
+	return matches[n].lineno;
+}
+
+size_t MatchIndex::start(size_t n) const
+{
+	return matches[n].x;
+}
+
+size_t MatchIndex::length(size_t n) const
+{
+	return matches[n].len;
+}
+
+/* Return the length of the character at s, which isn't the end of the
+ * string, as move_mbright() would step over it.  The conversion state
+ * is our own, so that this can run beside the main thread. */
+size_t MatchIndex::char_length(const char *s) const
+{
+	if (!utf8 || (unsigned char)*s < 0x80) {
+		return 1;
+	}
+
+	mbstate_t state;
+	memset(&state, 0, sizeof(state));
+
+	size_t len = mbrlen(s, MB_CUR_MAX, &state);
+
+	return (len == (size_t)-1 || len == (size_t)-2 || len == 0) ? 1 : len;
+}
+
+/* Go through the lines and note each place where a search for the
+ * needle stops: the first match in a line, and then the first one at or
+ * after the character following the previous one, as when searching
+ * again from there. */
+void MatchIndex::run()
+{
+	for (const filestruct *fileptr = fileage; fileptr != NULL && !cancelled; fileptr = next_line(fileptr)) {
+		lines.push_back(fileptr->data);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		copied = true;
+	}
+	copy_done.notify_all();
+
+	for (size_t i = 0; i < lines.size() && !cancelled; i++) {
+		const char *text = lines[i].c_str();
+		size_t len = lines[i].size(), from = 0;
+
+		while (from <= len) {
+			size_t x, match_len;
+
+			if (regexp) {
+				regmatch_t found;
+
+				found.rm_so = 0;
+				found.rm_eo = len - from;
+				if (regexec(&compiled, text + from, 1, &found, ((from > 0) ? REG_NOTBOL : 0) | REG_STARTEND) != 0) {
+					break;
+				}
+				x = from + found.rm_so;
+				match_len = found.rm_eo - found.rm_so;
+			} else {
+				const char *found = literal.find(text + from);
+
+				if (found == NULL) {
+					break;
+				}
+				x = found - text;
+				match_len = needle.size();
+			}
+
+			matches.push_back(match{(ssize_t)i + 1, x, match_len});
+
+			if (x == len) {
+				break;
+			}
+			from = x + char_length(text + x);
+		}
+	}
+
+	/* The copy of the text has served its purpose. */
+	std::vector<std::string>().swap(lines);
+
+	finished.store(true, std::memory_order_release);
+}
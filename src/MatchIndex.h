@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pcreposix.h>
+#include <sys/types.h>
+
+#include "LiteralSearch.h"
+#include "types.h"
+
+/* Finds, on a thread of its own, every place in a copy of a buffer where
+ * searching for a string or regex again and again stops, so that we can
+ * tell how many matches there are, jump over the lines without any, and
+ * highlight the ones on the screen without searching for them anew.  The
+ * copy is made on that thread too; until it is done, the lines must not
+ * be changed. */
+class MatchIndex
+{
+	public:
+		MatchIndex(const filestruct *fileage, const char *needle, bool regexp, bool case_sensitive);
+		virtual ~MatchIndex();
+
+		void wait_for_copy();
+		bool is_for(const char *needle, bool regexp, bool case_sensitive) const;
+		bool is_current() const;
+		bool complete() const;
+		MatchIndex *renewed(const filestruct *fileage) const;
+
+		size_t count() const;
+		size_t number_of(ssize_t lineno, size_t x) const;
+		ssize_t line_with_match(ssize_t from, ssize_t to) const;
+		size_t first_on_line(ssize_t lineno) const;
+		ssize_t line(size_t n) const;
+		size_t start(size_t n) const;
+		size_t length(size_t n) const;
+
+	private:
+		void run();
+		size_t char_length(const char *s) const;
+
+		struct match {
+			ssize_t lineno;
+			size_t x;
+			size_t len;
+		};
+
+		const filestruct *fileage;
+		/* The first of the lines to copy. */
+
+		std::vector<std::string> lines;
+		/* The text of the lines, as it was when the index was begun. */
+
+		std::string needle;
+		/* What we look for. */
+
+		bool regexp;
+		/* Whether needle is a regex. */
+
+		bool case_sensitive;
+		/* Whether case matters. */
+
+		bool utf8;
+		/* Whether the text is UTF-8. */
+
+		size_t changes;
+		/* The value of text_changes when the lines were copied. */
+
+		bool usable;
+		/* Whether the regex compiled, so that the index means something. */
+
+		LiteralSearch literal;
+		/* The prepared needle, when it isn't a regex. */
+
+		regex_t compiled;
+		/* Our own copy of the regex, when it is one. */
+
+		std::vector<match> matches;
+		/* Where each match begins and how long it is, in order. */
+
+		std::atomic<bool> finished;
+		/* Whether all lines have been gone through. */
+
+		std::atomic<bool> cancelled;
+		/* Whether the index should stop early. */
+
+		bool copied;
+		/* Whether the worker is done with the lines of the buffer. */
+
+		std::mutex lock;
+		std::condition_variable copy_done;
+		/* Guard copied, and tell of its change. */
+
+		std::thread worker;
+};
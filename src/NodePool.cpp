@@ -0,0 +1,153 @@
+#include "NodePool.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "proto.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/* Get a slab of memory aligned to its size.  Mapping it rather than
+ * taking it from the heap wastes nothing on the alignment, and the pages
+ * of the slab that aren't used yet don't take up any memory. */
+static void *get_slab(void)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+	char *mem = (char *)mmap(NULL, 2 * NODE_SLAB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *start;
+
+	if (mem == MAP_FAILED) {
+		die(_("pinot is out of memory!"));
+	}
+
+	/* Keep just the aligned slab out of twice its size. */
+	start = (char *)(((uintptr_t)mem + NODE_SLAB_BYTES - 1) & ~(uintptr_t)(NODE_SLAB_BYTES - 1));
+	if (start > mem) {
+		munmap(mem, start - mem);
+	}
+	munmap(start + NODE_SLAB_BYTES, mem + NODE_SLAB_BYTES - start);
+
+	return start;
+#else
+	void *mem;
+
+	if (posix_memalign(&mem, NODE_SLAB_BYTES, NODE_SLAB_BYTES) != 0) {
+		die(_("pinot is out of memory!"));
+	}
+
+	return mem;
+#endif
+}
+
+/* Give a slab of memory back. */
+static void put_slab(void *mem)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+	munmap(mem, NODE_SLAB_BYTES);
+#else
+	free(mem);
+#endif
+}
+
+NodePool::NodePool(size_t slot_size)
+: slot_size((slot_size + sizeof(slot) - 1) / sizeof(slot) * sizeof(slot)),
+  newest_slab(nullptr),
+  free_slots(nullptr),
+  in_use(0),
+  orphaned(false)
+{
+	slots_per_slab = (NODE_SLAB_BYTES - sizeof(slab)) / this->slot_size;
+	slab_used = slots_per_slab;
+}
+
+NodePool::~NodePool()
+{
+	while (newest_slab != nullptr) {
+		slab *s = newest_slab;
+
+		newest_slab = s->next;
+		put_slab(s);
+	}
+}
+
+/* Return the address of the nth slot of the given slab. */
+char *NodePool::slot_at(slab *s, size_t n) const
+{
+	return (char *)(s + 1) + n * slot_size;
+}
+
+/* Hand out a slot: a freed one if there is one, and otherwise the next
+ * one of the newest slab, getting a new slab when that one is used up. */
+void *NodePool::allocate()
+{
+	void *ptr;
+
+	if (free_slots != nullptr) {
+		ptr = free_slots;
+		free_slots = free_slots->next_free;
+	} else {
+		if (slab_used == slots_per_slab) {
+			slab *s = (slab *)get_slab();
+
+			s->pool = this;
+			s->next = newest_slab;
+			newest_slab = s;
+			slab_used = 0;
+		}
+		ptr = slot_at(newest_slab, slab_used++);
+	}
+
+	in_use++;
+
+	return ptr;
+}
+
+/* Return the slab that the given slot is part of. */
+static inline void *slab_of(const void *ptr)
+{
+	return (void *)((uintptr_t)ptr & ~(uintptr_t)(NODE_SLAB_BYTES - 1));
+}
+
+/* Return whether the given slot came from this pool. */
+bool NodePool::holds(const void *ptr) const
+{
+	return ((const slab *)slab_of(ptr))->pool == this;
+}
+
+/* Give a slot back to the pool it came from.  An orphaned pool goes
+ * away when its last slot comes back. */
+void NodePool::release(void *ptr)
+{
+	slab *s = (slab *)slab_of(ptr);
+	NodePool *pool = s->pool;
+	slot *freed = (slot *)ptr;
+
+	assert(pool->in_use > 0);
+
+	if (--pool->in_use == 0 && pool->orphaned) {
+		delete pool;
+		return;
+	}
+
+	freed->next_free = pool->free_slots;
+	pool->free_slots = freed;
+}
+
+/* Take back count slots at once, without being told which, and orphan
+ * the pool: its owner has dropped them and won't allocate any more.
+ * When no other slots are in use, release all the slabs straight away. */
+void NodePool::release_all(size_t count)
+{
+	assert(in_use >= count);
+
+	in_use -= count;
+
+	if (in_use == 0) {
+		delete this;
+	} else {
+		orphaned = true;
+	}
+}
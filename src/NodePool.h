@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+/* Hands out the memory for the line nodes of one buffer, carved out of
+ * slabs of NODE_SLAB_BYTES bytes.  The slabs are aligned to their size,
+ * so the pool a node came from can be found from the node's address.
+ * When the buffer is closed, all of its slabs are released at once; if
+ * some of its nodes are still in use elsewhere (in the cutbuffer, say),
+ * the pool is orphaned instead, and goes away with the last of them. */
+class NodePool
+{
+	public:
+		NodePool(size_t slot_size);
+		~NodePool();
+
+		void *allocate();
+		static void release(void *ptr);
+		bool holds(const void *ptr) const;
+		void release_all(size_t count);
+
+	private:
+		struct slab {
+			NodePool *pool;
+			/* The pool this slab belongs to. */
+			slab *next;
+			/* The slab allocated before this one. */
+		};
+
+		struct slot {
+			slot *next_free;
+			/* The next slot given back, if this one is free. */
+		};
+
+		size_t slot_size;
+		/* The size of a slot, a multiple of sizeof(slot). */
+
+		size_t slots_per_slab;
+		/* How many slots fit in a slab after its header. */
+
+		slab *newest_slab;
+		/* The slab we're handing out slots from. */
+
+		size_t slab_used;
+		/* How many slots of the newest slab have been used. */
+
+		slot *free_slots;
+		/* The slots that have been handed out and given back. */
+
+		size_t in_use;
+		/* How many slots are handed out. */
+
+		bool orphaned;
+		/* Whether the buffer that owned the pool has been closed. */
+
+		char *slot_at(slab *s, size_t n) const;
+};
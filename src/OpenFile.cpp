@@ -3,23 +3,58 @@
 #include "proto.h"
 
 OpenFile::OpenFile()
-: fileage(nullptr),
+: nodes(nullptr),
+  fileage(nullptr),
   filebot(nullptr),
   edittop(nullptr),
   current(nullptr),
   current_stat(nullptr),
-  last_action(OTHER)
+  window_start(0),
+  window_end(0),
+  undotop(nullptr),
+  current_undo(nullptr),
+  undo_size(0),
+  last_action(OTHER),
+  highlight_from(1),
+  multi_ends_changes(0),
+  precalc(nullptr),
+  precalc_valid(0),
+  matches(nullptr),
+  matches_collected(false),
+  brackets(nullptr)
 {
 	// nothing to do here
 }
 
 OpenFile::~OpenFile()
 {
+	if (current_stat != nullptr) {
+		delete current_stat;
+	}
+
+	while (undotop != nullptr) {
+		undo *u = undotop;
+		undotop = undotop->next;
+		free_undo(u);
+	}
+
+	/* A scan or an index may still be copying the lines, so stop them
+	 * first. */
+	delete precalc;
+	delete matches;
+
+	/* The lines are going away with the whole buffer, so there's no
+	 * need to keep their stretches up to date, and the nodes can go
+	 * back to the buffer's pool all at once. */
 	if (fileage != nullptr) {
-		free_filestruct(fileage);
+		release_filestruct(fileage, nodes);
+	} else if (nodes != nullptr) {
+		nodes->release_all(0);
 	}
 
-	if (current_stat != nullptr) {
-		delete current_stat;
+	for (auto chunk : line_chunks) {
+		delete chunk;
 	}
+
+	delete brackets;
 }
@@ -5,6 +5,11 @@ using std::string;
 
 #include "types.h"
 
+class BracketIndex;
+class HighlightScan;
+class MatchIndex;
+class NodePool;
+
 class OpenFile
 {
 	public:
@@ -14,6 +19,10 @@ class OpenFile
 		/* The current file's name. */
 		string filename;
 
+		/* Where the current file's line nodes come from, once it
+		 * has any. */
+		NodePool *nodes;
+
 		/* The current file's first line. */
 		filestruct *fileage;
 
@@ -26,9 +35,18 @@ class OpenFile
 		/* The current file's current line. */
 		filestruct *current;
 
+		/* The stretches of lines that the current file's lines are
+		 * numbered by, in order. */
+		std::vector<linechunk *> line_chunks;
+
 		/* The current file's total number of characters. */
 		size_t totsize;
 
+		/* The current file's number of words, if wordcount_valid is set,
+		 * that is, if nothing has changed since they were counted. */
+		size_t wordcount;
+		bool wordcount_valid;
+
 		/* The current file's x-coordinate position. */
 		size_t current_x;
 
@@ -56,12 +74,22 @@ class OpenFile
 		/* The current file's stat. */
 		struct stat *current_stat;
 
+		/* When the current file is too big to be read in whole, the
+		 * bytes of it that the buffer holds, from window_start up to
+		 * window_end.  window_end is zero when the buffer holds all of
+		 * the file. */
+		off_t window_start;
+		off_t window_end;
+
 		/* Top of the undo list */
 		undo *undotop;
 
 		/* The current (i.e. n ext) level of undo */
 		undo *current_undo;
 
+		/* How many bytes the undo items take up altogether */
+		size_t undo_size;
+
 		UndoType last_action;
 
 		/* The path of the lockfile, if we created one */
@@ -73,4 +101,30 @@ class OpenFile
 		/* The current file's associated colors. */
 		ColorList colorstrings;
 
+		/* The first line whose highlighting may have to be worked out
+		 * again, because it or a line before it has changed. */
+		ssize_t highlight_from;
+
+		/* For each color, the line where the last search for the end of
+		 * its multi-line regex started and the line where it found one
+		 * (zero if none), as long as text_changes was multi_ends_changes. */
+		std::vector<std::pair<ssize_t, ssize_t> > multi_ends;
+		size_t multi_ends_changes;
+
+		/* The scan working out the highlighting state of the lines in
+		 * the background, if one is under way, and the first line that
+		 * has changed since it started. */
+		HighlightScan *precalc;
+		ssize_t precalc_valid;
+
+		/* Where the last thing searched for matches in the buffer, as
+		 * far as that is known, and whether the main loop has taken
+		 * notice of the index since it was completed. */
+		MatchIndex *matches;
+		bool matches_collected;
+
+		/* How the depth of the last pair of brackets matched changes
+		 * over the lines, as far as it is known. */
+		BracketIndex *brackets;
+
 };
@@ -0,0 +1,91 @@
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <signal.h>
+
+WorkerPool::WorkerPool()
+: count(std::thread::hardware_concurrency()),
+  jobs(0),
+  running(0),
+  quitting(false)
+{
+	// nothing to do here
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quitting = true;
+	}
+	job_ready.notify_all();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+/* Return how many threads run each job. */
+size_t WorkerPool::size() const
+{
+	return count;
+}
+
+/* Have every thread run job once, starting the threads first if this is
+ * the first job.  The previous job must have finished. */
+void WorkerPool::start(std::function<void()> job)
+{
+	if (threads.empty()) {
+		/* As with HighlightScan, the signal handlers must stay on the
+		 * main thread. */
+		sigset_t all_signals, old_signals;
+
+		sigfillset(&all_signals);
+		pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+		for (size_t i = 0; i < count; i++) {
+			threads.push_back(std::thread(&WorkerPool::run, this));
+		}
+		pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		this->job = job;
+		running = threads.size();
+		jobs++;
+	}
+	job_ready.notify_all();
+}
+
+/* Wait at most timeout milliseconds for the current job to be finished,
+ * and return whether it is. */
+bool WorkerPool::wait_for(int timeout)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	return job_done.wait_for(guard, std::chrono::milliseconds(timeout), [this] { return running == 0; });
+}
+
+void WorkerPool::run()
+{
+	size_t done = 0;
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true) {
+		job_ready.wait(guard, [this, done] { return quitting || jobs != done; });
+		if (quitting) {
+			return;
+		}
+		done = jobs;
+
+		std::function<void()> current = job;
+
+		guard.unlock();
+		current();
+		guard.lock();
+
+		if (--running == 0) {
+			job_done.notify_all();
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A thread for each processor, kept around to run one job after another,
+ * every job on all of the threads at once.  The threads are only started
+ * when the first job comes, so a pool that isn't used costs nothing. */
+class WorkerPool
+{
+	public:
+		WorkerPool();
+		virtual ~WorkerPool();
+
+		size_t size() const;
+		void start(std::function<void()> job);
+		bool wait_for(int timeout);
+
+	private:
+		void run();
+
+		size_t count;
+		/* How many threads the pool has once they're started. */
+
+		std::vector<std::thread> threads;
+		/* The threads themselves. */
+
+		std::function<void()> job;
+		/* What the threads are running, or are about to. */
+
+		size_t jobs;
+		/* How many jobs have been started. */
+
+		size_t running;
+		/* How many threads haven't finished the current job yet. */
+
+		bool quitting;
+		/* Whether the threads should stop. */
+
+		std::mutex lock;
+		std::condition_variable job_ready;
+		std::condition_variable job_done;
+		/* Guard the above, and tell of a new job and of its end. */
+};
@@ -24,6 +24,11 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef HAVE_WCHAR_H
 #include <wchar.h>
@@ -407,16 +412,14 @@ int parse_mbchar(const char *buf, char *chr, size_t *col)
 			 * and the width in columns of its visible equivalent as
 			 * returned by control_mbrep(). */
 			else if (is_cntrl_mbchar(buf)) {
-				char *ctrl_buf_mb = charalloc(MB_CUR_MAX);
+				char ctrl_buf_mb[MB_LEN_MAX];
 				int ctrl_buf_mb_len;
 
 				(*col)++;
 
-				ctrl_buf_mb = control_mbrep(buf, ctrl_buf_mb, &ctrl_buf_mb_len);
+				control_mbrep(buf, ctrl_buf_mb, &ctrl_buf_mb_len);
 
 				*col += mbwidth(ctrl_buf_mb);
-
-				free(ctrl_buf_mb);
 				/* If we have a normal character, get its width in columns
 				 * normally. */
 			} else {
@@ -455,6 +458,75 @@ int parse_mbchar(const char *buf, char *chr, size_t *col)
 	return buf_mb_len;
 }
 
+/* Return how many of the characters at the start of s are printable
+ * ASCII, space through tilde.  Each of those is one byte long and one
+ * column wide in any locale, so a whole run of them can be skipped
+ * without parsing them one by one.  With SSE2 we look at sixteen bytes
+ * at a time, using aligned loads so as never to read past the page
+ * holding the end of s, although we may read past the end itself. */
+#ifdef __SSE2__
+__attribute__((no_sanitize_address))
+#endif
+size_t printable_ascii_len(const char *s)
+{
+	const unsigned char *p = (const unsigned char *)s;
+
+	assert(s != NULL);
+
+#ifdef __SSE2__
+	const __m128i below = _mm_set1_epi8(' ' - 1), above = _mm_set1_epi8('~' + 1);
+
+	for (; ((uintptr_t)p & 15) != 0; p++) {
+		if (*p < ' ' || *p > '~') {
+			return p - (const unsigned char *)s;
+		}
+	}
+
+	while (true) {
+		__m128i chunk = _mm_load_si128((const __m128i *)p);
+		/* Bytes with the high bit set compare as negative, so they fall
+		 * outside the range along with the control characters. */
+		int printable = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(chunk, below), _mm_cmplt_epi8(chunk, above)));
+
+		if (printable != 0xFFFF) {
+			return p - (const unsigned char *)s + __builtin_ctz(~printable);
+		}
+
+		p += 16;
+	}
+#else
+	while (*p >= ' ' && *p <= '~') {
+		p++;
+	}
+
+	return p - (const unsigned char *)s;
+#endif
+}
+
+/* Return whether the len bytes at s are all ASCII. */
+bool ascii_only(const char *s, size_t len)
+{
+	size_t i = 0;
+
+	assert(s != NULL);
+
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))) != 0) {
+			return false;
+		}
+	}
+#endif
+
+	for (; i < len; i++) {
+		if ((unsigned char)s[i] > 0x7F) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /* Return the index in buf of the beginning of the multibyte character
  * before the one at pos. */
 size_t move_mbleft(const std::string& str, size_t pos)
@@ -22,6 +22,7 @@
 
 #include "proto.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -136,6 +137,17 @@ void color_update(void)
 	openfile->syntax = NULL;
 	openfile->colorstrings.clear();
 
+	/* Whatever the lines were highlighted with before doesn't apply
+	 * anymore. */
+	for (filestruct *fileptr = openfile->fileage; fileptr != NULL; fileptr = next_line(fileptr)) {
+		delete fileptr->highlight;
+		fileptr->highlight = NULL;
+	}
+	openfile->highlight_from = 1;
+	openfile->multi_ends.clear();
+	delete openfile->precalc;
+	openfile->precalc = NULL;
+
 	// If the rcfiles were not read, or contained no syntaxes, get out
 	if (syntaxes.empty()) {
 		return;
@@ -269,116 +281,327 @@ void color_update(void)
 	}
 }
 
-/* Reset the multicolor info cache for records for any lines which need
-   to be recalculated */
-void reset_multis_after(filestruct *fileptr, int mindex)
+/* Note that line lineno has changed, so that the highlighting of it and
+ * of the lines after it has to be checked again before it's used, and
+ * what is known about the brackets in them is no longer so. */
+void reset_multis(ssize_t lineno)
 {
-	filestruct *oof;
-	for (oof = fileptr->next; oof != NULL; oof = oof->next) {
-		alloc_multidata_if_needed(oof);
-		if (oof->multidata.empty()) {
-			continue;
+	if (lineno < openfile->highlight_from) {
+		openfile->highlight_from = lineno;
+	}
+	if (lineno < openfile->precalc_valid) {
+		openfile->precalc_valid = lineno;
+	}
+	if (openfile->brackets != NULL) {
+		openfile->brackets->forget_from(lineno);
+	}
+}
+
+/* Return a hash of text, and store its length in len. */
+size_t text_hash(const char *text, size_t *len)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	size_t hash = (size_t)14695981039346656037ULL;
+
+	for (; *p != '\0'; p++) {
+		hash = (hash ^ *p) * (size_t)1099511628211ULL;
+	}
+
+	*len = p - (const unsigned char *)text;
+
+	return hash;
+}
+
+/* Find where the multi-line regex of color applies in the line text,
+ * which is len bytes long, given whether the regex is open at the start
+ * of the line.  Add the stretches it paints to found, if that isn't NULL,
+ * and return whether the regex is still open at the end of the line. */
+static bool scan_multi(const char *text, size_t len, const ColorPtr& color, bool open, colorspans *found)
+{
+	regmatch_t startmatch, endmatch;
+	size_t pos = 0;
+
+	if (open) {
+		if (regexec(color->end, text, 1, &endmatch, 0) == REG_NOMATCH) {
+			if (found != NULL) {
+				found->spans.push_back(std::make_pair((size_t)0, len));
+			}
+			return true;
 		}
-		if (oof->multidata[mindex] != CNONE) {
-			oof->multidata[mindex] = -1;
-		} else {
-			break;
+		pos = endmatch.rm_eo;
+		if (found != NULL) {
+			found->spans.push_back(std::make_pair((size_t)0, pos));
 		}
 	}
-	for (; oof != NULL; oof = oof->next) {
-		alloc_multidata_if_needed(oof);
-		if (oof->multidata.empty()) {
+
+	while (pos <= len && regexec(color->start, text + pos, 1, &startmatch, (pos == 0) ? 0 : REG_NOTBOL) == 0) {
+		size_t start = pos + startmatch.rm_so;
+
+		pos += startmatch.rm_eo;
+
+		/* Skip over a zero-length regex match. */
+		if (start == pos) {
+			pos++;
 			continue;
 		}
-		if (oof->multidata[mindex] == CNONE) {
-			oof->multidata[mindex] = -1;
-		} else {
-			break;
+
+		/* A start without an end on this line is open to the end of it. */
+		if (regexec(color->end, text + pos, 1, &endmatch, REG_NOTBOL) == REG_NOMATCH) {
+			if (found != NULL) {
+				found->spans.push_back(std::make_pair(start, len));
+			}
+			return true;
+		}
+
+		pos += endmatch.rm_eo;
+		if (found != NULL) {
+			found->spans.push_back(std::make_pair(start, pos));
 		}
 	}
-	edit_refresh_needed = true;
+
+	return false;
 }
 
-void reset_multis_before(filestruct *fileptr, int mindex)
+/* Work out, for each of the given colors, whether its multi-line regex
+ * is open at the start and at the end of the line text, which is len
+ * bytes long, given the state of the line before it, if there is one. */
+void multi_state(const char *text, size_t len, const ColorList& colors, const unsigned char *prev_state, unsigned char *state)
 {
-	filestruct *oof;
-	for (oof = fileptr->prev; oof != NULL; oof = oof->prev) {
-		alloc_multidata_if_needed(oof);
-		if (oof->multidata.empty()) {
-			continue;
+	size_t i = 0;
+
+	for (const auto& tmpcolor : colors) {
+		state[i] = 0;
+		if (tmpcolor->end != NULL) {
+			bool open = (prev_state != NULL && (prev_state[i] & MULTI_OPEN_AFTER));
+
+			state[i] = (open ? MULTI_OPEN_BEFORE : 0) | (scan_multi(text, len, tmpcolor, open, NULL) ? MULTI_OPEN_AFTER : 0);
 		}
-		if (oof->multidata[mindex] != CNONE) {
-			oof->multidata[mindex] = -1;
+		i++;
+	}
+}
+
+/* Make sure that the cached highlighting state of fileptr is up to date,
+ * taking that of the line before it as given, and return it.  The line
+ * is only looked at again when its text, or which multi-line regexes
+ * are open at its start, has changed. */
+linecolors *check_multis(filestruct *fileptr)
+{
+	const linecolors *prev = (fileptr->prev != NULL) ? fileptr->prev->highlight : NULL;
+	linecolors *colors = fileptr->highlight;
+	size_t ncolors = openfile->colorstrings.size(), len = 0, hash = 0, i;
+	bool hashed = false, same = false;
+
+	if (prev != NULL && prev->state.size() != ncolors) {
+		prev = NULL;
+	}
+
+	if (colors == NULL) {
+		colors = fileptr->highlight = new linecolors;
+	} else if (colors->state.size() == ncolors) {
+		if (colors->changes == text_changes) {
+			same = true;
 		} else {
-			break;
+			hash = text_hash(fileptr->data, &len);
+			hashed = true;
+			same = (len == colors->len && hash == colors->hash);
 		}
 	}
-	for (; oof != NULL; oof = oof->prev) {
-		alloc_multidata_if_needed(oof);
-		if (oof->multidata.empty()) {
-			continue;
-		}
-		if (oof->multidata[mindex] == CNONE) {
-			oof->multidata[mindex] = -1;
-		} else {
-			break;
+
+	for (i = 0; same && i < ncolors; i++) {
+		bool open = (prev != NULL && (prev->state[i] & MULTI_OPEN_AFTER));
+
+		if (open != ((colors->state[i] & MULTI_OPEN_BEFORE) != 0)) {
+			same = false;
 		}
 	}
 
-	edit_refresh_needed = true;
-}
+	if (same) {
+		colors->changes = text_changes;
+		return colors;
+	}
 
-/* Reset one multiline regex info */
-void reset_multis_for_id(filestruct *fileptr, int num)
-{
-	reset_multis_before(fileptr, num);
-	reset_multis_after(fileptr, num);
-	fileptr->multidata[num] = -1;
+	if (!hashed) {
+		hash = text_hash(fileptr->data, &len);
+	}
+
+	colors->len = len;
+	colors->hash = hash;
+	colors->changes = text_changes;
+	colors->state.resize(ncolors);
+	colors->colors.clear();
+	multi_state(fileptr->data, len, openfile->colorstrings, (prev != NULL) ? prev->state.data() : NULL, colors->state.data());
+
+	return colors;
 }
 
-/* Reset multi line strings around a filestruct ptr, trying to be smart about stopping
-   force = reset everything regardless, useful when we don't know how much screen state
-           has changed  */
-void reset_multis(filestruct *fileptr, bool force)
+/* Bring the cached highlighting of fileptr up to date, with the matches
+ * of its single-line regexes found at least up to index endpos, and
+ * return it.  The state of the lines before it is brought up to date
+ * first, from the first line that may have changed on. */
+linecolors *highlight_line(filestruct *fileptr, size_t endpos)
 {
-	int nobegin, noend;
-	regmatch_t startmatch, endmatch;
+	linecolors *colors;
+	bool multis = (openfile->syntax != NULL && openfile->syntax->nmultis > 0);
+	bool settled = (fileptr->lineno <= openfile->highlight_from);
+	/* Whether the state of the lines before fileptr is up to date. */
+	size_t i = 0;
+
+	if (multis && !settled) {
+		collect_multicolorinfo();
+		settled = (fileptr->lineno <= openfile->highlight_from);
+	}
 
-	if (!openfile->syntax) {
-		return;
+	/* While a background scan hasn't got this far yet, don't wait for it,
+	 * but make do with how the line before ends as far as we know; the
+	 * line is shown again when the scan gets there. */
+	if (multis && !settled && openfile->precalc == NULL) {
+		filestruct *line = fileptr;
+
+		if (fileptr->lineno - openfile->highlight_from < LINE_INDEX_STRIDE) {
+			while (line->lineno > openfile->highlight_from && line->prev != NULL) {
+				line = line->prev;
+			}
+		} else {
+			line = line_from_number(openfile->highlight_from);
+		}
+
+		/* A line that was never highlighted says nothing about how the
+		 * lines after it start. */
+		while (line->prev != NULL && line->prev->highlight == NULL) {
+			line = line->prev;
+		}
+
+		for (; line != fileptr; line = next_line(line)) {
+			check_multis(line);
+		}
+		settled = true;
 	}
 
-	for (auto tmpcolor : openfile->colorstrings) {
+	colors = check_multis(fileptr);
 
-		/* If it's not a multi-line regex, amscray */
-		if (tmpcolor->end == NULL) {
-			continue;
+	if (settled && fileptr->lineno >= openfile->highlight_from) {
+		openfile->highlight_from = fileptr->lineno + 1;
+	}
+
+	if (colors->colors.empty()) {
+		colors->colors.resize(openfile->colorstrings.size());
+
+		for (auto tmpcolor : openfile->colorstrings) {
+			colorspans *found = &colors->colors[i++];
+
+			if (tmpcolor->end != NULL) {
+				scan_multi(fileptr->data, colors->len, tmpcolor, colors->state[i - 1] & MULTI_OPEN_BEFORE, found);
+				found->scanned = colors->len + 1;
+			} else {
+				found->scanned = 0;
+			}
 		}
+		i = 0;
+	}
 
-		alloc_multidata_if_needed(fileptr);
-		if (force == true) {
-			reset_multis_for_id(fileptr, tmpcolor->id);
-			continue;
+	for (auto tmpcolor : openfile->colorstrings) {
+		colorspans *found = &colors->colors[i++];
+		regmatch_t match;
+
+		/* We move past the end of the last match.  Even though two
+		 * matches may overlap, we want to ignore them, so that we can
+		 * highlight e.g. C strings correctly. */
+		while (found->scanned < endpos && found->scanned <= colors->len) {
+			if (regexec(tmpcolor->start, fileptr->data + found->scanned, 1, &match, (found->scanned == 0) ? 0 : REG_NOTBOL) == REG_NOMATCH) {
+				found->scanned = colors->len + 1;
+				break;
+			}
+
+			match.rm_so += found->scanned;
+			match.rm_eo += found->scanned;
+
+			/* Skip over a zero-length regex match. */
+			if (match.rm_so == match.rm_eo) {
+				match.rm_eo++;
+			} else {
+				found->spans.push_back(std::make_pair((size_t)match.rm_so, (size_t)match.rm_eo));
+			}
+			found->scanned = match.rm_eo;
 		}
+	}
 
-		/* Figure out where the first begin and end are to determine if
-		   things changed drastically for the precalculated multi values */
-		nobegin = regexec(tmpcolor->start, fileptr->data, 1, &startmatch, 0);
-		noend = regexec(tmpcolor->end, fileptr->data, 1, &endmatch, 0);
-		if (fileptr->multidata[tmpcolor->id] == CWHOLELINE) {
-			if (nobegin && noend) {
-				continue;
+	return colors;
+}
+
+/* Take over what the background scan of the current buffer has worked
+ * out so far, for the lines that haven't changed since it started, and
+ * get rid of the scan once it has nothing more to offer.  Return whether
+ * this settled the highlighting of any line on the screen. */
+bool collect_multicolorinfo(void)
+{
+	HighlightScan *scan = openfile->precalc;
+	size_t ncolors = openfile->colorstrings.size();
+	ssize_t first = openfile->highlight_from, last;
+	filestruct *fileptr;
+
+	if (scan == NULL || filepart != NULL) {
+		return false;
+	}
+
+	last = std::min((ssize_t)scan->done(), openfile->precalc_valid - 1);
+
+	if (last >= first) {
+		for (fileptr = line_from_number(first); fileptr != NULL && fileptr->lineno <= last; fileptr = next_line(fileptr)) {
+			size_t index = fileptr->lineno - 1;
+			linecolors *colors = fileptr->highlight;
+
+			if (colors == NULL) {
+				colors = fileptr->highlight = new linecolors;
 			}
-		} else if (fileptr->multidata[tmpcolor->id] == CNONE) {
-			if (nobegin && noend) {
-				continue;
+
+			/* Keep what was painted before, if it still applies. */
+			if (colors->state.size() != ncolors || colors->len != scan->len(index) || colors->hash != scan->hash(index) || memcmp(colors->state.data(), scan->state(index), ncolors) != 0) {
+				colors->len = scan->len(index);
+				colors->hash = scan->hash(index);
+				colors->state.assign(scan->state(index), scan->state(index) + ncolors);
+				colors->colors.clear();
 			}
-		}  else if (fileptr->multidata[tmpcolor->id] & CBEGINBEFORE && !noend && (nobegin || endmatch.rm_eo > startmatch.rm_eo)) {
-			reset_multis_after(fileptr, tmpcolor->id);
-			continue;
+
+			/* Have the text checked against the hash before it's used. */
+			colors->changes = (size_t)-1;
 		}
+		openfile->highlight_from = last + 1;
+	}
 
-		/* If we got here assume the worst */
-		reset_multis_for_id(fileptr, tmpcolor->id);
+	if (scan->done() == scan->size() || (ssize_t)scan->done() >= openfile->precalc_valid - 1) {
+		delete scan;
+		openfile->precalc = NULL;
 	}
+
+	return (last >= first && first < openfile->edittop->lineno + editwinrows);
+}
+
+/* Return whether the multi-line regex of the index'th color, which is
+ * still open at the end of fileptr, gets closed on a later line.  We
+ * don't paint unterminated starts. */
+bool multi_ends_later(const filestruct *fileptr, size_t index, const ColorPtr& color)
+{
+	ssize_t from = fileptr->lineno + 1;
+	const filestruct *line;
+
+	if (openfile->multi_ends_changes != text_changes || openfile->multi_ends.size() != openfile->colorstrings.size()) {
+		openfile->multi_ends.assign(openfile->colorstrings.size(), std::make_pair(0, 0));
+		openfile->multi_ends_changes = text_changes;
+	}
+
+	std::pair<ssize_t, ssize_t>& search = openfile->multi_ends[index];
+
+	/* If an earlier search went over the lines after fileptr, it has
+	 * the answer already. */
+	if (search.first > 0 && search.first <= from && (search.second == 0 || search.second >= from)) {
+		return (search.second != 0);
+	}
+
+	for (line = fileptr->next; line != NULL && regexec(color->end, line->data, 0, NULL, 0) == REG_NOMATCH; line = next_line(line)) {
+		;
+	}
+
+	search = std::make_pair(from, (line != NULL) ? line->lineno : 0);
+
+	return (line != NULL);
 }
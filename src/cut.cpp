@@ -203,7 +203,7 @@ void do_cut_text(bool copy_text, bool cut_till_eof, bool undoing)
 	/* Update the screen. */
 	edit_refresh_needed = true;
 
-	reset_multis(openfile->current, false);
+	reset_multis(openfile->current->lineno);
 
 #ifdef DEBUG
 	dump_filestruct(cutbuffer);
@@ -254,6 +254,10 @@ void do_uncut_text(void)
 
 	update_undo(PASTE);
 
+	/* The pasted text starts here, so this is where the highlighting
+	 * has to be checked again from. */
+	reset_multis(openfile->current->lineno);
+
 	/* Add a copy of the text in the cutbuffer to the current filestruct
 	 * at the current cursor position. */
 	copy_from_filestruct(cutbuffer);
@@ -270,8 +274,6 @@ void do_uncut_text(void)
 	/* Update the screen. */
 	edit_refresh_needed = true;
 
-	reset_multis(openfile->current, false);
-
 #ifdef DEBUG
 	dump_filestruct_reverse();
 #endif
@@ -23,6 +23,7 @@
 #include "proto.h"
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 
 #include <stdio.h>
@@ -33,6 +34,15 @@
 #include <errno.h>
 #include <ctype.h>
 #include <pwd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 /* Add an entry to the list of open files. This should only be called from open_buffer(). */
 void make_new_buffer(void)
@@ -74,8 +84,11 @@ void initialize_buffer(void)
 	openfile->fmt = NIX_FILE;
 
 	openfile->current_stat = nullptr;
+	openfile->window_start = 0;
+	openfile->window_end = 0;
 	openfile->undotop = NULL;
 	openfile->current_undo = NULL;
+	openfile->undo_size = 0;
 }
 
 /* Initialize the text of the current entry of the openfiles list */
@@ -83,6 +96,8 @@ void initialize_buffer_text(void)
 {
 	assert(openfile != openfiles.end());
 
+	forget_line_chunks();
+
 	openfile->fileage = make_new_node(NULL);
 	openfile->fileage->data = mallocstrcpy(NULL, "");
 
@@ -90,9 +105,13 @@ void initialize_buffer_text(void)
 	openfile->edittop = openfile->fileage;
 	openfile->current = openfile->fileage;
 
-	openfile->fileage->multidata.clear();
-
 	openfile->totsize = 0;
+	openfile->wordcount_valid = false;
+	openfile->highlight_from = 1;
+	delete openfile->precalc;
+	openfile->precalc = NULL;
+	delete openfile->brackets;
+	openfile->brackets = NULL;
 }
 
 /* Actually write the lock file.  This function will
@@ -327,7 +346,7 @@ void open_buffer(std::string filename, bool undoable)
 	/* If we have a non-new file, read it in.  Then, if the buffer has
 	 * no stat, update the stat, if applicable. */
 	if (rc > 0) {
-		read_file(f, rc, filename, undoable, new_buffer);
+		read_file(f, rc, filename, undoable, new_buffer, new_buffer);
 		if (openfile->current_stat == nullptr) {
 			openfile->current_stat = new struct stat;
 			stat(filename, openfile->current_stat);
@@ -346,6 +365,7 @@ void open_buffer(std::string filename, bool undoable)
 	 * for it, if applicable. */
 	if (new_buffer) {
 		color_update();
+		precalc_multicolorinfo();
 	}
 }
 
@@ -511,20 +531,22 @@ int is_file_writable(const std::string& filename)
 	return ans;
 }
 
-/* We make a new line of text from buf.  buf is length buf_len.  If
- * first_line_ins is true, then we put the new line at the top of the
- * file.  Otherwise, we assume prevnode is the last line of the file,
- * and put our line after prevnode. */
-filestruct *read_line(char *buf, filestruct *prevnode, bool *first_line_ins, size_t buf_len)
+/* We make a new line of text from the buf_len bytes at buf, which need
+ * not be null-terminated.  If first_line_ins is true, then we put the
+ * new line at the top of the file.  Otherwise, we assume prevnode is the
+ * last line of the file, and put our line after prevnode. */
+filestruct *read_line(const char *buf, filestruct *prevnode, bool *first_line_ins, size_t buf_len)
 {
 	filestruct *fileptr = new filestruct;
 
-	/* Convert nulls to newlines.  buf_len is the string's real length. */
-	unsunder(buf, buf_len);
+	assert(openfile->fileage != NULL);
 
-	assert(openfile->fileage != NULL && strlen(buf) == buf_len);
+	fileptr->data = charalloc(buf_len + 1);
+	memcpy(fileptr->data, buf, buf_len);
+	fileptr->data[buf_len] = '\0';
 
-	fileptr->data = mallocstrcpy(NULL, buf);
+	/* Convert nulls to newlines.  buf_len is the string's real length. */
+	unsunder(fileptr->data, buf_len);
 
 	/* If it's a DOS file ("\r\n"), and file conversion isn't disabled,
 	 * strip the '\r' part from fileptr->data. */
@@ -532,8 +554,6 @@ filestruct *read_line(char *buf, filestruct *prevnode, bool *first_line_ins, siz
 		fileptr->data[buf_len - 1] = '\0';
 	}
 
-	fileptr->multidata.clear();
-
 	if (*first_line_ins) {
 		/* Special case: We're inserting with the cursor on the first line. */
 		fileptr->prev = NULL;
@@ -561,32 +581,163 @@ filestruct *read_line(char *buf, filestruct *prevnode, bool *first_line_ins, siz
 	return fileptr;
 }
 
+/* Get the whole contents of the open file f in one piece, so that
+ * read_file() can split it into lines with memchr() instead of going
+ * through it a character at a time.  A regular file is mapped into
+ * memory; anything else (a pipe, stdin, or a file that can't be mapped)
+ * is read() in blocks of READ_BLOCK_SIZE bytes.  Set *size to the length
+ * of the contents and *mapped to whether they have to be munmap()ped
+ * instead of free()d.  On a read error, complain about filename and
+ * return what we got up to that point. */
+char *load_file_contents(FILE *f, const std::string& filename, size_t *size, bool *mapped)
+{
+	int fd = fileno(f);
+	char *contents = NULL;
+	size_t alloc_len = 0;
+	ssize_t got;
+
+	*size = 0;
+	*mapped = false;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+	struct stat fileinfo;
+
+	if (fstat(fd, &fileinfo) != -1 && S_ISREG(fileinfo.st_mode) && fileinfo.st_size > 0 &&
+	        (unsigned long long)fileinfo.st_size < (size_t)-1 && lseek(fd, 0, SEEK_CUR) == 0) {
+		void *map = mmap(NULL, fileinfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise(map, fileinfo.st_size, MADV_SEQUENTIAL);
+#endif
+			DEBUG_LOG("Mapped " << fileinfo.st_size << " bytes of " << filename);
+			*size = fileinfo.st_size;
+			*mapped = true;
+			return (char *)map;
+		}
+	}
+#endif
+
+	/* We can't map the file, so read it in big blocks instead. */
+	while (true) {
+		if (*size + READ_BLOCK_SIZE > alloc_len) {
+			alloc_len = (alloc_len == 0) ? READ_BLOCK_SIZE : alloc_len * 2;
+			contents = charealloc(contents, alloc_len);
+		}
+
+		got = read(fd, contents + *size, alloc_len - *size);
+
+		if (got == 0) {
+			break;
+		} else if (got < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* Perhaps this could use some better handling. */
+			nperror(filename.c_str());
+			break;
+		}
+
+		*size += got;
+	}
+
+	DEBUG_LOG("Read " << *size << " bytes of " << filename << " in blocks");
+
+	return contents;
+}
+
+/* Return how many bytes of a file we read in at most: the large file
+ * limit, or else an eighth of the memory there is, so that the lines
+ * made of them fit in it easily. */
+size_t file_part_size(void)
+{
+	long pages = sysconf(_SC_PHYS_PAGES), page_size = sysconf(_SC_PAGESIZE);
+
+	if (large_file_limit > 0) {
+		return (size_t)large_file_limit * 1048576;
+	} else if (pages <= 0 || page_size <= 0) {
+		return (size_t)-1;
+	}
+
+	return (size_t)pages / 8 * page_size;
+}
+
+/* Work out which stretch of the len bytes of contents the current buffer
+ * is to hold, going by what window_start and window_end of it ask for:
+ * at most file_part_size() bytes from window_start on, or, if window_end
+ * isn't zero, up to window_end.  The stretch is made to hold whole lines,
+ * and at least one of them. */
+void find_file_part(const char *contents, size_t len)
+{
+	size_t limit = file_part_size();
+	size_t from, to;
+
+	if (openfile->window_end == 0) {
+		from = std::min((size_t)openfile->window_start, len);
+		to = (len - from > limit) ? from + limit : len;
+
+		/* End the stretch after the last newline in it, or else after
+		 * the first one beyond it. */
+		if (to < len) {
+			const char *newline = (const char *)memrchr(contents + from, '\n', to - from);
+
+			if (newline == NULL) {
+				newline = (const char *)memchr(contents + to, '\n', len - to);
+			}
+			to = (newline != NULL) ? newline + 1 - contents : len;
+		}
+	} else {
+		to = std::min((size_t)openfile->window_end, len);
+		from = (to > limit) ? to - limit : 0;
+
+		/* Begin the stretch after the first newline before it or in
+		 * it, or else after the newline before its last line. */
+		if (from > 0) {
+			const char *newline = (const char *)memchr(contents + from - 1, '\n', to - from);
+
+			if (newline == NULL) {
+				newline = (const char *)memrchr(contents, '\n', (to > 0) ? to - 1 : 0);
+			}
+			from = (newline != NULL) ? newline + 1 - contents : 0;
+		}
+	}
+
+	/* If that comes to the whole file, the buffer isn't a part of it. */
+	if (from == 0 && to == len) {
+		openfile->window_start = 0;
+		openfile->window_end = 0;
+	} else {
+		openfile->window_start = from;
+		openfile->window_end = to;
+	}
+}
+
 /* Read an open file into the current buffer.  f should be set to the
  * open file, and filename should be set to the name of the file.
  * undoable  means do we want to create undo records to try and undo this.
  * Will also attempt to check file writability if fd > 0 and checkwritable == true
+ * If windowed is true and the file is bigger than file_part_size(), only
+ * the stretch of it that find_file_part() picks is read in.
  */
-void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool checkwritable)
+void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool checkwritable, bool windowed)
 {
 	size_t num_lines = 0;
 	/* The number of lines in the file. */
 	size_t len = 0;
-	/* The length of the current line of the file. */
-	size_t i = 0;
-	/* The position in the current line of the file. */
-	size_t bufx = MAX_BUF_SIZE;
-	/* The size of each chunk of the file that we read. */
-	char input = '\0';
-	/* The current input character. */
-	char *buf;
-	/* The buffer where we store chunks of the file. */
+	/* The length of the last line of the file, if it has no newline. */
+	char *contents;
+	/* The whole contents of the file. */
+	size_t contents_len;
+	/* The length of the contents. */
+	bool mapped;
+	/* Whether the contents are mapped rather than allocated. */
+	const char *start, *end;
+	/* The start of the current line of the file, and the end of the
+	 * contents. */
 	filestruct *fileptr = openfile->current;
 	/* The current line of the file. */
 	bool first_line_ins = false;
 	/* Whether we're inserting with the cursor on the first line. */
-	int input_int;
-	/* The current value we read from the file, whether an input
-	 * character or EOF. */
 	bool writable = true;
 	/* Is the file writable (if we care) */
 	int format = 0;
@@ -594,9 +745,6 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 
 	assert(openfile->fileage != NULL && openfile->current != NULL);
 
-	buf = charalloc(bufx);
-	buf[0] = '\0';
-
 	if (undoable) {
 		add_undo(INSERT);
 	}
@@ -607,95 +755,67 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 		fileptr = openfile->current->prev;
 	}
 
-	/* Read the entire file into the filestruct. */
-	while ((input_int = getc(f)) != EOF) {
-		input = (char)input_int;
+	contents = load_file_contents(f, filename, &contents_len, &mapped);
+	start = contents;
+	end = contents + contents_len;
+
+	/* Only a mapped file can be read in a stretch at a time, since the
+	 * rest of it has to be there for the next stretch. */
+	if (windowed && mapped && (contents_len > file_part_size() || openfile->window_end != 0)) {
+		find_file_part(contents, contents_len);
+		if (openfile->window_end != 0) {
+			start = contents + openfile->window_start;
+			end = contents + openfile->window_end;
+		}
+	} else if (windowed) {
+		openfile->window_start = 0;
+		openfile->window_end = 0;
+	}
+
+	/* Read the entire file into the filestruct, a line at a time. */
+	while (start < end) {
+		const char *newline = (const char *)memchr(start, '\n', end - start);
+		const char *stop = (newline != NULL) ? newline : end;
+
+		/* A '\r' only counts as a line ending when file conversion isn't
+		 * disabled, and only on the first line if we think it's a *nix
+		 * file, or on any line otherwise. */
+		if (!ISSET(NO_CONVERT) && (num_lines == 0 || format != 0)) {
+			const char *cr = (const char *)memchr(start, '\r', stop - start);
+
+			if (cr != NULL && cr + 1 < stop) {
+				/* If it's a Mac file ('\r' without '\n'), set format to
+				 * Mac if we currently think the file is a *nix file, or
+				 * to both DOS and Mac if we currently think the file is
+				 * a DOS file.  Then read in the line properly. */
+				if (format == 0 || format == 1) {
+					format += 2;
+				}
 
-		/* If it's a *nix file ("\n") or a DOS file ("\r\n"), and file
-		 * conversion isn't disabled, handle it! */
-		if (input == '\n') {
-			/* If it's a DOS file or a DOS/Mac file ('\r' before '\n' on
-			 * the first line if we think it's a *nix file, or on any
-			 * line otherwise), and file conversion isn't disabled,
-			 * handle it! */
-			if (!ISSET(NO_CONVERT) && (num_lines == 0 || format != 0) && i > 0 && buf[i - 1] == '\r') {
+				fileptr = read_line(start, fileptr, &first_line_ins, cr + 1 - start);
+				num_lines++;
+				start = cr + 1;
+				continue;
+			} else if (cr != NULL && newline != NULL) {
+				/* It's a DOS file or a DOS/Mac file ("\r\n"). */
 				if (format == 0 || format == 2) {
 					format++;
 				}
 			}
+		}
 
-			/* Read in the line properly. */
-			fileptr = read_line(buf, fileptr, &first_line_ins, len);
-
-			/* Reset the line length in preparation for the next
-			 * line. */
-			len = 0;
-
-			num_lines++;
-			buf[0] = '\0';
-			i = 0;
-			/* If it's a Mac file ('\r' without '\n' on the first line if we
-			 * think it's a *nix file, or on any line otherwise), and file
-			 * conversion isn't disabled, handle it! */
-		} else if (!ISSET(NO_CONVERT) && (num_lines == 0 || format != 0) && i > 0 && buf[i - 1] == '\r') {
-			/* If we currently think the file is a *nix file, set format
-			 * to Mac.  If we currently think the file is a DOS file,
-			 * set format to both DOS and Mac. */
-			if (format == 0 || format == 1) {
-				format += 2;
-			}
-
-			/* Read in the line properly. */
-			fileptr = read_line(buf, fileptr, &first_line_ins, len);
-
-			/* Reset the line length in preparation for the next line.
-			 * Since we've already read in the next character, reset it
-			 * to 1 instead of 0. */
-			len = 1;
-
-			num_lines++;
-			buf[0] = input;
-			buf[1] = '\0';
-			i = 1;
-		} else {
-			/* Calculate the total length of the line.  It might have
-			 * nulls in it, so we can't just use strlen() here. */
-			len++;
-
-			/* Now we allocate a bigger buffer MAX_BUF_SIZE characters
-			 * at a time.  If we allocate a lot of space for one line,
-			 * we may indeed have to use a buffer this big later on, so
-			 * we don't decrease it at all.  We do free it at the end,
-			 * though. */
-			if (i >= bufx - 1) {
-				bufx += MAX_BUF_SIZE;
-				buf = charealloc(buf, bufx);
-			}
-
-			buf[i] = input;
-			buf[i + 1] = '\0';
-			i++;
+		/* The last line has no newline; deal with it below. */
+		if (newline == NULL) {
+			break;
 		}
-	}
 
-	/* Perhaps this could use some better handling. */
-	if (ferror(f)) {
-		nperror(filename.c_str());
-	}
-	fclose(f);
-	if (fd > 0 && checkwritable) {
-		close(fd);
-		writable = is_file_writable(filename);
+		/* Read in the line properly. */
+		fileptr = read_line(start, fileptr, &first_line_ins, newline - start);
+		num_lines++;
+		start = newline + 1;
 	}
 
-	/* If file conversion isn't disabled and the last character in this
-	 * file is '\r', read it in properly as a Mac format line. */
-	if (len == 0 && !ISSET(NO_CONVERT) && input == '\r') {
-		len = 1;
-
-		buf[0] = input;
-		buf[1] = '\0';
-	}
+	len = end - start;
 
 	/* Did we not get a newline and still have stuff to do? */
 	if (len > 0) {
@@ -703,16 +823,27 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 		 * this file is '\r', set format to Mac if we currently think
 		 * the file is a *nix file, or to both DOS and Mac if we
 		 * currently think the file is a DOS file. */
-		if (!ISSET(NO_CONVERT) && buf[len - 1] == '\r' && (format == 0 || format == 1)) {
+		if (!ISSET(NO_CONVERT) && start[len - 1] == '\r' && (format == 0 || format == 1)) {
 			format += 2;
 		}
 
 		/* Read in the last line properly. */
-		fileptr = read_line(buf, fileptr, &first_line_ins, len);
+		fileptr = read_line(start, fileptr, &first_line_ins, len);
 		num_lines++;
 	}
 
-	free(buf);
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+	if (mapped) {
+		munmap(contents, contents_len);
+	} else
+#endif
+		free(contents);
+
+	fclose(f);
+	if (fd > 0 && checkwritable) {
+		close(fd);
+		writable = is_file_writable(filename);
+	}
 
 	/* If we didn't get a file and we don't already have one, open a blank buffer. */
 	if (fileptr == NULL) {
@@ -727,6 +858,9 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 		if (len > 0) {
 			size_t current_len = strlen(openfile->current->data);
 
+			/* A trailing '\r' has been stripped from the line by now. */
+			len = strlen(fileptr->data);
+
 			/* Adjust the current x-coordinate to compensate for the
 			 * change in the current line. */
 			if (num_lines == 1) {
@@ -739,6 +873,7 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 			openfile->current->data = charealloc(openfile->current->data, len + current_len + 1);
 			charmove(openfile->current->data + len, openfile->current->data, current_len + 1);
 			strncpy(openfile->current->data, fileptr->data, len);
+			forget_widths(openfile->current);
 
 			/* Don't destroy fileage, edittop, or filebot! */
 			if (fileptr == openfile->fileage) {
@@ -755,7 +890,7 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 			 * since its text has been saved. */
 			fileptr = fileptr->prev;
 			if (fileptr != NULL) {
-				free(fileptr->next);
+				delete_node(fileptr->next);
 			}
 		}
 
@@ -827,6 +962,88 @@ void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool
 		statusbar(P_("Read %lu line ( Warning: No write permission)",
 		             "Read %lu lines (Warning: No write permission)",
 		             (unsigned long)num_lines), (unsigned long)num_lines);
+
+	/* When we've read only part of the file, say which part. */
+	if (windowed && openfile->window_end != 0) {
+		statusbar(P_("Read %lu line (bytes %llu to %llu of %llu)",
+		             "Read %lu lines (bytes %llu to %llu of %llu)",
+		             (unsigned long)num_lines), (unsigned long)num_lines,
+		          (unsigned long long)openfile->window_start, (unsigned long long)openfile->window_end,
+		          (unsigned long long)contents_len);
+	}
+}
+
+/* Replace the text of the current buffer, which holds part of its file,
+ * with the part of the file that follows it, or, if previous is true,
+ * with the part that precedes it. */
+void load_file_part(bool previous)
+{
+	FILE *f;
+	int fd;
+
+	if (openfile->window_end == 0) {
+		statusbar(_("The whole file is in the buffer"));
+		return;
+	} else if (previous && openfile->window_start == 0) {
+		statusbar(_("Already at the beginning of the file"));
+		return;
+	} else if (!previous && openfile->current_stat != nullptr && openfile->window_end >= openfile->current_stat->st_size) {
+		statusbar(_("Already at the end of the file"));
+		return;
+	} else if (openfile->modified) {
+		statusbar(_("Save the buffer before going to another part of the file"));
+		return;
+	}
+
+	fd = open_file(openfile->filename, false, false, &f);
+	if (fd < 0) {
+		return;
+	}
+
+	if (previous) {
+		openfile->window_end = openfile->window_start;
+	} else {
+		openfile->window_start = openfile->window_end;
+		openfile->window_end = 0;
+	}
+
+	/* The undo history and anything worked out from the old lines don't
+	 * apply to the new ones. */
+	while (openfile->undotop != NULL) {
+		undo *u = openfile->undotop;
+		openfile->undotop = u->next;
+		free_undo(u);
+	}
+	openfile->current_undo = NULL;
+	openfile->undo_size = 0;
+	openfile->last_action = OTHER;
+	openfile->mark_set = false;
+	text_changes++;
+
+	free_filestruct(openfile->fileage);
+	initialize_buffer_text();
+
+	read_file(f, fd, openfile->filename, false, true, true);
+	stat(openfile->filename, openfile->current_stat);
+
+	openfile->current = openfile->fileage;
+	openfile->current_x = 0;
+	openfile->placewewant = 0;
+	precalc_multicolorinfo();
+
+	edit_refresh_needed = true;
+}
+
+/* Go to the part of the file that follows the one in the buffer. */
+void do_next_part(void)
+{
+	load_file_part(false);
+}
+
+/* Go to the part of the file that precedes the one in the buffer. */
+void do_prev_part(void)
+{
+	load_file_part(true);
 }
 
 /* Open the file (and decide if it exists).  If newfie is true, display
@@ -1410,28 +1627,107 @@ void init_backup_dir(void)
 	}
 }
 
+/* Return whether an error from copy_file_range() or sendfile() means
+ * just that that way of copying can't be used for these files. */
+bool copy_unsupported(int error)
+{
+	return (error == ENOSYS || error == EXDEV || error == EINVAL || error == EBADF || error == EOPNOTSUPP);
+}
+
+/* Return how many bytes to copy next, at most COPY_BLOCK_SIZE, when
+ * copied bytes of len have been copied.  A negative len means there is
+ * no end to it. */
+size_t copy_block(off_t len, size_t copied)
+{
+	if (len < 0 || len - (off_t)copied > COPY_BLOCK_SIZE) {
+		return COPY_BLOCK_SIZE;
+	}
+
+	return len - copied;
+}
+
+/* Copy len bytes from in_fd to out_fd, or everything up to the end of
+ * in_fd if len is negative, from where their file offsets are.  The
+ * kernel is asked to do the copying, with copy_file_range() or else
+ * sendfile(), so that the data doesn't have to pass through us; when it
+ * can't, we read and write in large blocks.  We return 0 on success, -1
+ * on read error or when in_fd ends too soon, or -2 on write error. */
+int copy_fd(int in_fd, int out_fd, off_t len)
+{
+	int retval = 0;
+	ssize_t copied = 0;
+	bool done = false;
+	/* Whether the copying has come to an end, one way or another. */
+	size_t total = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while (copy_block(len, total) > 0 && (copied = copy_file_range(in_fd, NULL, out_fd, NULL, copy_block(len, total), 0)) > 0) {
+		total += copied;
+	}
+	done = (copy_block(len, total) == 0 || copied == 0 || !copy_unsupported(errno));
+	DEBUG_LOG("copy_file_range() has copied " << total << " bytes" << (done ? "" : ", and can't go on"));
+#endif
+
+#ifdef HAVE_SENDFILE
+	if (!done) {
+		while (copy_block(len, total) > 0 && (copied = sendfile(out_fd, in_fd, NULL, copy_block(len, total))) > 0) {
+			total += copied;
+		}
+		done = (copy_block(len, total) == 0 || copied == 0 || !copy_unsupported(errno));
+		DEBUG_LOG("sendfile() has copied " << total << " bytes in all" << (done ? "" : ", and can't go on"));
+	}
+#endif
+
+	if (!done) {
+		std::vector<char> buf(COPY_BLOCK_SIZE);
+
+		while (copy_block(len, total) > 0 && (copied = read(in_fd, buf.data(), copy_block(len, total))) > 0) {
+			for (ssize_t written = 0, count; written < copied; written += count) {
+				count = write(out_fd, &buf[written], copied - written);
+				if (count == -1) {
+					retval = -2;
+					break;
+				}
+			}
+			if (retval != 0) {
+				break;
+			}
+			total += copied;
+		}
+		DEBUG_LOG("read() and write() have copied " << total << " bytes in all");
+	}
+
+	/* Tell apart the errors that can only come from the writing. */
+	if (copied == -1 && retval == 0) {
+		retval = (errno == ENOSPC || errno == EDQUOT || errno == EFBIG) ? -2 : -1;
+	} else if (retval == 0 && len >= 0 && total < (size_t)len) {
+		retval = -1;
+	}
+
+	return retval;
+}
+
 /* Read from inn, write to out.  We assume inn is opened for reading,
- * and out for writing.  We return 0 on success, -1 on read error, or -2
- * on write error. */
+ * and out for writing.  The copying is done by copy_fd(), around the
+ * streams.  We return 0 on success, -1 on read error, or -2 on write
+ * error. */
 int copy_file(FILE *inn, FILE *out)
 {
-	int retval = 0;
-	char buf[BUFSIZ];
-	size_t charsread;
+	int retval;
+	off_t in_at = ftello(inn);
 
 	assert(inn != NULL && out != NULL && inn != out);
 
-	do {
-		charsread = fread(buf, sizeof(char), BUFSIZ, inn);
-		if (charsread == 0 && ferror(inn)) {
-			retval = -1;
-			break;
-		}
-		if (fwrite(buf, sizeof(char), charsread, out) < charsread) {
-			retval = -2;
-			break;
+	/* Whatever out holds has to be written first, and inn's file offset
+	 * has to be where the stream is. */
+	if (fflush(out) != 0) {
+		retval = -2;
+	} else {
+		if (in_at != -1) {
+			lseek(fileno(inn), in_at, SEEK_SET);
 		}
-	} while (charsread > 0);
+		retval = copy_fd(fileno(inn), fileno(out), -1);
+	}
 
 	if (fclose(inn) == EOF) {
 		retval = -1;
@@ -1486,6 +1782,18 @@ bool write_file(const std::string& name, FILE *f_open, bool tmp, AppendType appe
 	/* The actual file, realname, we are writing to. */
 	std::string tempname;
 	/* The temp file name we write to on prepend. */
+	bool atomic = false;
+	/* Whether we write to a new file beside realname and then rename
+	 * it over realname, instead of rewriting realname in place. */
+	std::string atomicname;
+	/* The name of that new file, until it has been renamed. */
+	int atomic_fd = -1;
+	/* The new file, until we have a stream for it. */
+	bool spliced = false;
+	/* Whether the buffer holds only part of realname, so that the new
+	 * file has to get the rest of it around the buffer's text. */
+	size_t written = 0;
+	/* How many bytes of the buffer's text we wrote. */
 
 	if (name == "") {
 		return -1;
@@ -1528,6 +1836,45 @@ bool write_file(const std::string& name, FILE *f_open, bool tmp, AppendType appe
 		stat(realname, openfile->current_stat);
 	}
 
+	/* When saving a buffer that holds only part of its file, the file
+	 * must still be the one that part came from. */
+	if (openfile->window_end != 0 && !tmp && append == OVERWRITE && !openfile->mark_set && f_open == NULL && realexists &&
+	        openfile->current_stat != nullptr && st.st_dev == openfile->current_stat->st_dev && st.st_ino == openfile->current_stat->st_ino) {
+		if (st.st_size != openfile->current_stat->st_size || st.st_mtime != openfile->current_stat->st_mtime) {
+			statusbar(_("Error writing %s: %s"), realname.c_str(), _("The file has changed since it was read"));
+			goto cleanup_and_exit;
+		}
+		spliced = true;
+	}
+
+	/* Save by way of a new file only when that comes to the same thing as
+	 * overwriting the old one: when it's a plain file that no other name
+	 * links to, and the new file can get its owner and permissions.  When
+	 * prepending, or saving part of a file, always try to, so that the
+	 * old text can go into the new file around the buffer, in one pass. */
+	if ((ISSET(ATOMIC_SAVE) || append == PREPEND || spliced) && !tmp && append != APPEND && f_open == NULL && realexists && !S_ISLNK(lst.st_mode) && S_ISREG(st.st_mode) && st.st_nlink == 1) {
+		atomicname = realname + ".XXXXXX";
+		atomic_fd = mkstemp(atomicname);
+
+		if (atomic_fd != -1 && fchown(atomic_fd, st.st_uid, st.st_gid) != -1 && fchmod(atomic_fd, st.st_mode & 07777) != -1) {
+			atomic = true;
+		} else {
+			DEBUG_LOG("Can't save " << realname << " by way of a new file: " << strerror(errno));
+			if (atomic_fd != -1) {
+				close(atomic_fd);
+				unlink(atomicname);
+				atomic_fd = -1;
+			}
+			atomicname = "";
+		}
+	}
+
+	/* Writing only part of a file over all of it would lose the rest. */
+	if (spliced && !atomic) {
+		statusbar(_("Error writing %s: %s"), realname.c_str(), _("Only part of it is in the buffer"));
+		goto cleanup_and_exit;
+	}
+
 	/* We backup only if the backup toggle is set, the file isn't
 	 * temporary, and the file already exists.  Furthermore, if we
 	 * aren't appending, prepending, or writing a selection, we backup
@@ -1610,10 +1957,21 @@ bool write_file(const std::string& name, FILE *f_open, bool tmp, AppendType appe
 			goto cleanup_and_exit;
 		}
 
+		/* When the original file is going to be replaced rather than
+		 * overwritten, another link to it will do as the backup. */
+		if (atomic && link(realname.c_str(), backupname.c_str()) != -1) {
+			DEBUG_LOG("Linked " << realname << " to " << backupname);
+			fclose(f);
+			goto skip_backup;
+		}
+
 		if (ISSET(INSECURE_BACKUP)) {
 			backup_cflags = O_WRONLY | O_CREAT | O_APPEND;
 		} else {
-			backup_cflags = O_WRONLY | O_CREAT | O_EXCL | O_APPEND;
+			/* The file is new, so there is nothing to append to, and
+			 * without O_APPEND copy_file() can leave the copying to
+			 * the kernel. */
+			backup_cflags = O_WRONLY | O_CREAT | O_EXCL;
 		}
 
 		backup_fd = open(backupname.c_str(), backup_cflags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
@@ -1697,8 +2055,8 @@ skip_backup:
 		}
 	}
 
-	/* If we're prepending, copy the file to a temp file. */
-	if (append == PREPEND) {
+	/* If we're prepending in place, copy the file to a temp file. */
+	if (append == PREPEND && !atomic) {
 		int fd_source;
 		FILE *f_source = NULL;
 
@@ -1742,7 +2100,30 @@ skip_backup:
 		}
 	}
 
-	if (f_open == NULL) {
+	if (atomic) {
+		f = fdopen(atomic_fd, "wb");
+
+		if (f == NULL) {
+			statusbar(_("Error writing %s: %s"), atomicname.c_str(), strerror(errno));
+			goto cleanup_and_exit;
+		}
+		atomic_fd = -1;
+
+		/* The part of the file before the buffer's goes first. */
+		if (spliced) {
+			int head_fd = open(realname.c_str(), O_RDONLY);
+
+			if (head_fd == -1 || copy_fd(head_fd, fileno(f), openfile->window_start) != 0) {
+				statusbar(_("Error writing %s: %s"), atomicname.c_str(), strerror(errno));
+				if (head_fd != -1) {
+					close(head_fd);
+				}
+				fclose(f);
+				goto cleanup_and_exit;
+			}
+			close(head_fd);
+		}
+	} else if (f_open == NULL) {
 		/* Now open the file in place.  Use O_EXCL if tmp is true.  This
 		 * is copied from joe, because wiggy says so *shrug*. */
 		fd = open(realname.c_str(), O_WRONLY | O_CREAT | ((append == APPEND) ? O_APPEND : (tmp ? O_EXCL : O_TRUNC)), S_IRUSR |S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
@@ -1773,55 +2154,73 @@ skip_backup:
 	/* There might not be a magicline.  There won't be when writing out a selection. */
 	assert(openfile->fileage != NULL && openfile->filebot != NULL);
 
-	while (fileptr != NULL) {
-		size_t data_len = strlen(fileptr->data), size;
+	{
+		LineWriter writer(f, openfile->fmt);
+#ifdef DEBUG
+		auto write_start = std::chrono::steady_clock::now();
+#endif
 
-		/* Convert newlines to nulls, just before we write to disk. */
-		sunder(fileptr->data);
+		while (fileptr != NULL) {
+			/* If we're on the last line of the file, don't write a
+			 * newline character after it. */
+			if (!writer.add_line(fileptr->data, strlen(fileptr->data)) ||
+			        (fileptr != openfile->filebot && !writer.add_ending())) {
+				statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
+				fclose(f);
+				goto cleanup_and_exit;
+			}
 
-		size = fwrite(fileptr->data, sizeof(char), data_len, f);
+			/* If the last line of the file is blank, zero bytes are
+			 * written for it, in which case we don't count it in the
+			 * total lines written. */
+			if (fileptr == openfile->filebot && fileptr->data[0] == '\0') {
+				lineswritten--;
+			}
 
-		/* Convert nulls to newlines.  data_len is the string's real length. */
-		unsunder(fileptr->data, data_len);
+			fileptr = next_line(fileptr);
+			lineswritten++;
+		}
 
-		if (size < data_len) {
+		if (!writer.flush()) {
 			statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
 			fclose(f);
 			goto cleanup_and_exit;
 		}
 
-		/* If we're on the last line of the file, don't write a newline
-		 * character after it.  If the last line of the file is blank,
-		 * this means that zero bytes are written, in which case we
-		 * don't count the last line in the total lines written. */
-		if (fileptr == openfile->filebot) {
-			if (fileptr->data[0] == '\0') {
-				lineswritten--;
-			}
-		} else {
-			if (openfile->fmt == DOS_FILE || openfile->fmt == MAC_FILE) {
-				if (putc('\r', f) == EOF) {
-					statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
-					fclose(f);
-					goto cleanup_and_exit;
-				}
-			}
+		written = writer.bytes_written();
 
-			if (openfile->fmt != MAC_FILE) {
-				if (putc('\n', f) == EOF) {
-					statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
-					fclose(f);
-					goto cleanup_and_exit;
-				}
+#ifdef DEBUG
+		std::chrono::duration<double> took = std::chrono::steady_clock::now() - write_start;
+		DEBUG_LOG("Wrote " << writer.bytes_written() << " bytes in " << took.count() << " seconds (" << writer.bytes_written() / 1048576.0 / took.count() << " MB/s)");
+#endif
+	}
+
+	if (atomic && (append == PREPEND || spliced)) {
+		/* Add the old text, or the part of it after the buffer's, to the
+		 * new file, and make sure all of it is on the disk before it
+		 * takes the place of the old one. */
+		FILE *f_source = fopen(realname, "rb");
+		int sync_fd = dup(fileno(f));
+
+		if (f_source == NULL || (spliced && fseeko(f_source, openfile->window_end, SEEK_SET) == -1)) {
+			statusbar(_("Error reading %s: %s"), realname.c_str(), strerror(errno));
+			beep();
+			if (f_source != NULL) {
+				fclose(f_source);
 			}
+			fclose(f);
+			close(sync_fd);
+			goto cleanup_and_exit;
 		}
 
-		fileptr = fileptr->next;
-		lineswritten++;
-	}
-
-	/* If we're prepending, open the temp file, and append it to f. */
-	if (append == PREPEND) {
+		if (copy_file(f_source, f) != 0 || fsync(sync_fd) == -1) {
+			statusbar(_("Error writing %s: %s"), atomicname.c_str(), strerror(errno));
+			close(sync_fd);
+			goto cleanup_and_exit;
+		}
+		close(sync_fd);
+	} else if (append == PREPEND) {
+		/* Open the temp file, and append it to f. */
 		int fd_source;
 		FILE *f_source = NULL;
 
@@ -1845,12 +2244,44 @@ skip_backup:
 			statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
 			goto cleanup_and_exit;
 		}
-	} else if (fclose(f) != 0) {
-		statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
-		goto cleanup_and_exit;
+	} else {
+		/* Make sure that all of a new file is on the disk before it
+		 * takes the place of the old one. */
+		bool synced = (!atomic || (fflush(f) == 0 && fsync(fileno(f)) == 0));
+
+		if (fclose(f) != 0 || !synced) {
+			statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
+			goto cleanup_and_exit;
+		}
+	}
+
+	if (atomic) {
+		if (rename(atomicname.c_str(), realname.c_str()) == -1) {
+			statusbar(_("Error writing %s: %s"), realname.c_str(), strerror(errno));
+			goto cleanup_and_exit;
+		}
+		atomicname = "";
+
+		/* And make sure that the renaming is on the disk too. */
+		std::string dir = realname.substr(0, realname.rfind('/') + 1);
+		int dir_fd = open((dir == "") ? "." : dir.c_str(), O_RDONLY);
+
+		if (dir_fd != -1) {
+			fsync(dir_fd);
+			close(dir_fd);
+		}
 	}
 
 	if (!tmp && append == OVERWRITE) {
+		/* The buffer's part of the file now ends where its text does,
+		 * unless the buffer has become the whole of another file. */
+		if (spliced) {
+			openfile->window_end = openfile->window_start + written;
+		} else if (!nonamechange) {
+			openfile->window_start = 0;
+			openfile->window_end = 0;
+		}
+
 		if (!nonamechange) {
 			openfile->filename = realname;
 			/* We might have changed the filename, so update the colors
@@ -1881,6 +2312,14 @@ skip_backup:
 	retval = true;
 
 cleanup_and_exit:
+	/* If the new file didn't get to replace the old one, get rid of it. */
+	if (atomic_fd != -1) {
+		close(atomic_fd);
+	}
+	if (atomicname != "") {
+		unlink(atomicname);
+	}
+
 	return retval;
 }
 
@@ -94,6 +94,19 @@ ssize_t tabsize = -1;
 /* The width of a tab in spaces. The default value is set in
  * main(). */
 
+size_t text_changes = 0;
+/* How many times the text has been changed; what the highlighting and
+ * the match index know of the text from before the last change may be
+ * out of date. */
+
+ssize_t undo_limit = 0;
+/* How many kilobytes the undo history of a buffer may take up before
+ * the oldest actions are forgotten, or 0 for no limit. */
+
+ssize_t large_file_limit = 0;
+/* How many megabytes of a file are read in at a time when it's bigger
+ * than that, or 0 for an eighth of the memory there is. */
+
 std::string backup_dir = "";
 /* The directory where we store backup files. */
 const std::string locking_prefix = ".";
@@ -329,6 +342,9 @@ void shortcut_init(void)
 	const char *pinot_unindent_msg = N_("Unindent the current line");
 	const char *pinot_undo_msg = N_("Undo the last operation");
 	const char *pinot_redo_msg = N_("Redo the last undone operation");
+	const char *pinot_undousage_msg = N_("Show how much memory the undo history takes up");
+	const char *pinot_prevpart_msg = N_("Go to the previous part of a file too big to read in whole");
+	const char *pinot_nextpart_msg = N_("Go to the next part of a file too big to read in whole");
 	const char *pinot_forward_msg = N_("Go forward one character");
 	const char *pinot_back_msg = N_("Go back one character");
 	const char *pinot_nextword_msg = N_("Go forward one word");
@@ -436,6 +452,9 @@ void shortcut_init(void)
 	add_to_funcs(do_first_line, MMAIN|MHELP|MWHEREIS|MREPLACE|MREPLACEWITH|MGOTOLINE, N_("First Line"), pinot_firstline_msg, GROUP_TOGETHER, VIEW);
 	add_to_funcs(do_last_line, MMAIN|MHELP|MWHEREIS|MREPLACE|MREPLACEWITH|MGOTOLINE, N_("Last Line"), pinot_lastline_msg, BLANK_AFTER, VIEW);
 
+	add_to_funcs(do_prev_part, MMAIN, N_("Prev Part"), pinot_prevpart_msg, GROUP_TOGETHER, VIEW);
+	add_to_funcs(do_next_part, MMAIN, N_("Next Part"), pinot_nextpart_msg, BLANK_AFTER, VIEW);
+
 	add_to_funcs(do_research, MMAIN, whereis_next_tag, pinot_whereis_next_msg, GROUP_TOGETHER, VIEW);
 
 	add_to_funcs(do_find_bracket, MMAIN, N_("To Bracket"), pinot_bracket_msg, GROUP_TOGETHER, VIEW);
@@ -448,7 +467,8 @@ void shortcut_init(void)
 	add_to_funcs(do_unindent, MMAIN, N_("Unindent Text"), pinot_unindent_msg, BLANK_AFTER, NOVIEW);
 
 	add_to_funcs(do_undo, MMAIN, N_("Undo"), pinot_undo_msg, GROUP_TOGETHER, NOVIEW);
-	add_to_funcs(do_redo, MMAIN, N_("Redo"), pinot_redo_msg, BLANK_AFTER, NOVIEW);
+	add_to_funcs(do_redo, MMAIN, N_("Redo"), pinot_redo_msg, GROUP_TOGETHER, NOVIEW);
+	add_to_funcs(do_undo_usage, MMAIN, N_("Undo Usage"), pinot_undousage_msg, BLANK_AFTER, VIEW);
 
 	add_to_funcs(do_left, MMAIN, N_("Back"), pinot_back_msg, GROUP_TOGETHER, VIEW);
 	add_to_funcs(do_right, MMAIN, N_("Forward"), pinot_forward_msg, GROUP_TOGETHER, VIEW);
@@ -570,6 +590,9 @@ void shortcut_init(void)
 	add_to_sclist(MMAIN|MHELP, "M-/", do_last_line);
 	add_to_sclist(MMAIN|MHELP, "M-?", do_last_line);
 
+	add_to_sclist(MMAIN, "M-(", do_prev_part);
+	add_to_sclist(MMAIN, "M-)", do_next_part);
+
 	add_to_sclist(MMAIN|MBROWSER, "M-W", do_research);
 	add_to_sclist(MMAIN|MBROWSER, "F16", do_research);
 
@@ -587,6 +610,7 @@ void shortcut_init(void)
 
 	add_to_sclist(MMAIN, "M-U", do_undo);
 	add_to_sclist(MMAIN, "M-E", do_redo);
+	add_to_sclist(MMAIN, "M-J", do_undo_usage);
 
 	add_to_sclist(MMOST, "^B", do_left);
 	add_to_sclist(MMOST, "Left", do_left);
@@ -853,6 +877,10 @@ sc *strtosc(std::string input)
 		s->scfunc = do_prev_word_void;
 	} else if (input == "nextword") {
 		s->scfunc = do_next_word_void;
+	} else if (input == "prevpart") {
+		s->scfunc = do_prev_part;
+	} else if (input == "nextpart") {
+		s->scfunc = do_next_part;
 	} else if (input == "findbracket") {
 		s->scfunc = do_find_bracket;
 	} else if (input == "wordcount") {
@@ -863,6 +891,8 @@ sc *strtosc(std::string input)
 		s->scfunc = do_undo;
 	} else if (input == "redo") {
 		s->scfunc = do_redo;
+	} else if (input == "undousage") {
+		s->scfunc = do_undo_usage;
 	} else if (input == "prevhistory") {
 		s->scfunc = get_history_older_void;
 	} else if (input == "nexthistory") {
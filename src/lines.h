@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+/* Have the processor start loading a line into the cache, so that it's
+ * there by the time a scan over the buffer gets to it.  Nothing is read
+ * through the pointer, so it may be NULL. */
+inline void prefetch_line(const filestruct *fileptr)
+{
+#ifdef __GNUC__
+	__builtin_prefetch(fileptr);
+#endif
+}
+
+/* Step from fileptr to the line after it.  While the caller works on
+ * that line, the one after it gets loaded, so that a scan over the
+ * buffer doesn't wait on memory at every line. */
+inline filestruct *next_line(const filestruct *fileptr)
+{
+	filestruct *next = fileptr->next;
+
+	if (next != NULL) {
+		prefetch_line(next->next);
+	}
+
+	return next;
+}
+
+/* Step from fileptr to the line before it, loading the one before that
+ * in the meantime. */
+inline filestruct *prev_line(const filestruct *fileptr)
+{
+	filestruct *prev = fileptr->prev;
+
+	if (prev != NULL) {
+		prefetch_line(prev->prev);
+	}
+
+	return prev;
+}
@@ -70,12 +70,12 @@ void do_page_up(void)
 	for (i = editwinrows - 2; i - skipped > 0 && openfile->current != openfile->fileage; i--) {
 		openfile->current = openfile->current->prev;
 		if (ISSET(SOFTWRAP) && openfile->current) {
-			skipped += strlenpt(openfile->current->data) / COLS;
-			DEBUG_LOG("do_page_up: i = " << i << ", skipped = " << skipped << " based on line " << openfile->current->lineno << "  len " << strlenpt(openfile->current->data));
+			skipped += line_strlenpt(openfile->current) / COLS;
+			DEBUG_LOG("do_page_up: i = " << i << ", skipped = " << skipped << " based on line " << openfile->current->lineno << "  len " << line_strlenpt(openfile->current));
 		}
 	}
 
-	openfile->current_x = actual_x(openfile->current->data, openfile->placewewant);
+	openfile->current_x = line_actual_x(openfile->current, openfile->placewewant);
 
 	DEBUG_LOG("do_page_up: openfile->current->lineno = " << openfile->current->lineno << ", skipped = " << skipped);
 
@@ -108,7 +108,7 @@ void do_page_down(void)
 		DEBUG_LOG("do_page_down: moving to line " << openfile->current->lineno);
 	}
 
-	openfile->current_x = actual_x(openfile->current->data, openfile->placewewant);
+	openfile->current_x = line_actual_x(openfile->current, openfile->placewewant);
 
 	/* Scroll the edit window down a page. */
 	edit_update(NONE);
@@ -395,7 +395,7 @@ void do_up(bool scroll_only)
 
 	/* Move the current line of the edit window up. */
 	openfile->current = openfile->current->prev;
-	openfile->current_x = actual_x(openfile->current->data, openfile->placewewant);
+	openfile->current_x = line_actual_x(openfile->current, openfile->placewewant);
 
 	/* If scroll_only is false and if we're on the first line of the
 	 * edit window, scroll the edit window up one line if we're in
@@ -447,19 +447,19 @@ void do_down(bool scroll_only)
 
 	/* Move the current line of the edit window down. */
 	openfile->current = openfile->current->next;
-	openfile->current_x = actual_x(openfile->current->data, openfile->placewewant);
+	openfile->current_x = line_actual_x(openfile->current, openfile->placewewant);
 
 	if (ISSET(SOFTWRAP)) {
 		/* Compute the amount to scroll. */
-		amount = (strlenpt(openfile->current->data) / COLS + openfile->current_y + 2 + strlenpt(openfile->current->prev->data) / COLS - editwinrows);
+		amount = (line_strlenpt(openfile->current) / COLS + openfile->current_y + 2 + line_strlenpt(openfile->current->prev) / COLS - editwinrows);
 		topline = openfile->edittop;
 		/* Reduce the amount when there are overlong lines at the top. */
 		for (int enough = 1; enough < amount; enough++) {
-			if (amount <= strlenpt(topline->data) / COLS) {
+			if (amount <= line_strlenpt(topline) / COLS) {
 				amount = enough;
 				break;
 			}
-			amount -= strlenpt(topline->data) / COLS;
+			amount -= line_strlenpt(topline) / COLS;
 			topline = topline->next;
 		}
 	}
@@ -22,6 +22,8 @@
 
 #include "proto.h"
 
+#include <algorithm>
+
 #include <stdio.h>
 #include <stdarg.h>
 #include <signal.h>
@@ -31,7 +33,6 @@
 #include <errno.h>
 #include <ctype.h>
 #include <locale.h>
-#include <time.h>
 #include <langinfo.h>
 #include <termios.h>
 #ifdef HAVE_GETOPT_H
@@ -46,6 +47,33 @@ static struct termios oldterm;
 static struct sigaction act;
 /* Used to set up all our fun signal handlers. */
 
+static NodePool *spare_nodes = NULL;
+/* The pool for nodes made while no buffer is open. */
+
+/* Allocate the memory for a filestruct node from the pool of the
+ * current buffer, so that the nodes of a buffer sit together and can
+ * all be released at once when it is closed. */
+void *filestruct::operator new(size_t size)
+{
+	NodePool **pool = openfiles.empty() ? &spare_nodes : &openfile->nodes;
+
+	assert(size == sizeof(filestruct));
+
+	if (*pool == NULL) {
+		*pool = new NodePool(sizeof(filestruct));
+	}
+
+	return (*pool)->allocate();
+}
+
+/* Give the memory of a filestruct node back to its pool. */
+void filestruct::operator delete(void *ptr)
+{
+	if (ptr != NULL) {
+		NodePool::release(ptr);
+	}
+}
+
 /* Create a new filestruct node.  Note that we do not set prevnode->next
  * to the new line. */
 filestruct *make_new_node(filestruct *prevnode)
@@ -108,7 +136,14 @@ void delete_node(filestruct *fileptr)
 {
 	assert(fileptr != NULL);
 
+	/* Don't leave a freed line at the start of its stretch of lines. */
+	if (fileptr->lineno.chunk != NULL && fileptr->lineno.chunk->head == fileptr) {
+		fileptr->lineno.chunk->head = NULL;
+	}
+
 	free(fileptr->data);
+	delete fileptr->widths;
+	delete fileptr->highlight;
 
 	delete fileptr;
 }
@@ -151,6 +186,34 @@ void free_filestruct(filestruct *src)
 	delete_node(src);
 }
 
+/* Free the lines of a buffer that is being closed.  The nodes that came
+ * from the buffer's own pool aren't given back one by one; the pool
+ * takes them all back at once afterward. */
+void release_filestruct(filestruct *src, NodePool *pool)
+{
+	size_t pooled = 0;
+
+	while (src != NULL) {
+		filestruct *next = src->next;
+
+		free(src->data);
+		delete src->widths;
+		delete src->highlight;
+
+		if (pool != NULL && pool->holds(src)) {
+			pooled++;
+		} else {
+			delete src;
+		}
+
+		src = next;
+	}
+
+	if (pool != NULL) {
+		pool->release_all(pooled);
+	}
+}
+
 /* Renumber all entries in a filestruct, starting with fileptr. */
 void renumber(filestruct *fileptr)
 {
@@ -160,15 +223,162 @@ void renumber(filestruct *fileptr)
 		return;
 	}
 
-	line = (fileptr->prev == NULL) ? 0 : fileptr->prev->lineno;
-
 	assert(fileptr != fileptr->next);
 
+	/* The lines of the current buffer are numbered by stretches. */
+	if (filepart == NULL) {
+		renumber_chunks(fileptr);
+		return;
+	}
+
+	line = (fileptr->prev == NULL) ? 0 : fileptr->prev->lineno;
+
 	for (; fileptr != NULL; fileptr = fileptr->next) {
 		fileptr->lineno = ++line;
 	}
 }
 
+/* Renumber the lines of the current buffer, starting with fileptr.  The
+ * lines are kept in stretches of at most LINE_INDEX_STRIDE lines, each
+ * line numbered relative to the start of its stretch, so we only have
+ * to go over the stretch that fileptr is in, and then move the starting
+ * numbers of the stretches after it.  A stretch that has become too
+ * small takes in the next one, and one that has become too big is
+ * broken up into stretches of about the same size. */
+void renumber_chunks(filestruct *fileptr)
+{
+	std::vector<linechunk *>& chunks = openfile->line_chunks;
+	std::vector<linechunk *> added;
+	linechunk *chunk;
+	filestruct *start, *line;
+	size_t first, last, total = 0, at = 0, pieces, i;
+	bool passed = false;
+
+	/* Lines before fileptr that aren't in a stretch yet have been added
+	 * since the last renumbering, so begin with the first of them. */
+	while (fileptr->prev != NULL && fileptr->prev->lineno.chunk == NULL) {
+		fileptr = fileptr->prev;
+	}
+
+	/* Go back to the start of the stretch that the line before fileptr
+	 * is in; fileptr and the lines after it join that stretch. */
+	if (fileptr->prev == NULL) {
+		/* Lines that have been taken out of the buffer (by an undo, say)
+		 * aren't part of its stretches; just number them from one. */
+		if (fileptr != openfile->fileage) {
+			ssize_t line = 0;
+
+			for (; fileptr != NULL; fileptr = fileptr->next) {
+				fileptr->lineno = ++line;
+			}
+			return;
+		}
+		if (chunks.empty()) {
+			chunks.push_back(new linechunk);
+			chunks[0]->slot = 0;
+		}
+		chunk = chunks[0];
+		chunk->base = 1;
+		start = fileptr;
+	} else {
+		chunk = fileptr->prev->lineno.chunk;
+		start = fileptr->prev;
+		while (start->prev != NULL && start->prev->lineno.chunk == chunk) {
+			start = start->prev;
+		}
+	}
+
+	/* Find where the stretch ends: at the start of a later stretch, as
+	 * long as the lines up to there aren't too few to stand alone.  The
+	 * stretches from first up to last are taken in on the way. */
+	first = chunk->slot + 1;
+	last = chunks.size();
+
+	for (line = start; line != NULL; line = line->next, total++) {
+		linechunk *own = line->lineno.chunk;
+
+		if (passed && own != NULL && own->head == line && own->slot >= first && own->slot < chunks.size() && chunks[own->slot] == own && total >= LINE_INDEX_STRIDE / 2) {
+			last = own->slot;
+			break;
+		}
+
+		if (line == fileptr) {
+			passed = true;
+			at = total;
+		}
+	}
+
+	/* What is known about the brackets goes by line numbers. */
+	if (openfile->brackets != NULL) {
+		openfile->brackets->forget_from(chunk->base + at);
+	}
+
+	/* Number the lines, in as few stretches as will hold them. */
+	pieces = (total + LINE_INDEX_STRIDE - 1) / LINE_INDEX_STRIDE;
+	line = start;
+
+	for (i = 0; i < pieces; i++) {
+		size_t count = total / pieces + (i < total % pieces ? 1 : 0), n;
+
+		if (i > 0) {
+			chunk = new linechunk;
+			added.push_back(chunk);
+		}
+		chunk->head = line;
+		chunk->count = count;
+
+		for (n = 0; n < count; n++) {
+			line->lineno.chunk = chunk;
+			line->lineno.offset = n;
+			line = line->next;
+		}
+	}
+
+	for (i = first; i < last; i++) {
+		delete chunks[i];
+	}
+	chunks.erase(chunks.begin() + first, chunks.begin() + last);
+	chunks.insert(chunks.begin() + first, added.begin(), added.end());
+
+	for (i = first; i < chunks.size(); i++) {
+		chunks[i]->slot = i;
+		chunks[i]->base = chunks[i - 1]->base + chunks[i - 1]->count;
+	}
+}
+
+/* Forget the stretches of lines of the current buffer, since its lines
+ * are going away. */
+void forget_line_chunks(void)
+{
+	for (auto chunk : openfile->line_chunks) {
+		delete chunk;
+	}
+	openfile->line_chunks.clear();
+}
+
+/* Return the line of the current buffer that starts the stretch of lines
+ * closest before line lineno.  A stretch that starts at lineno itself
+ * won't do: lines that were just added in front of its first line and
+ * haven't been renumbered yet may have that number too. */
+filestruct *indexed_line(ssize_t lineno)
+{
+	std::vector<linechunk *>& chunks = openfile->line_chunks;
+	auto chunk = std::upper_bound(chunks.begin(), chunks.end(), lineno - 1, [](ssize_t number, const linechunk *c) {
+		return number < c->base;
+	});
+
+	assert(filepart == NULL);
+
+	while (chunk != chunks.begin()) {
+		--chunk;
+		if ((*chunk)->head != NULL) {
+			return (*chunk)->head;
+		}
+	}
+
+	return openfile->fileage;
+}
+
 /* Partition a filestruct so that it begins at (top, top_x) and ends at
  * (bot, bot_x). */
 partition *partition_filestruct(filestruct *top, size_t top_x, filestruct *bot, size_t bot_x)
@@ -177,6 +387,12 @@ partition *partition_filestruct(filestruct *top, size_t top_x, filestruct *bot,
 
 	assert(top != NULL && bot != NULL && openfile->fileage != NULL && openfile->filebot != NULL);
 
+	/* The lines of the partition may be renumbered relative to its top,
+	 * and what is known about their brackets goes by their numbers. */
+	if (openfile->brackets != NULL) {
+		openfile->brackets->forget_from(top->lineno);
+	}
+
 	/* Initialize the partition. */
 	p = (partition *)nmalloc(sizeof(partition));
 
@@ -213,10 +429,12 @@ partition *partition_filestruct(filestruct *top, size_t top_x, filestruct *bot,
 
 	/* Remove all text after bot_x at the bottom of the partition. */
 	null_at(&bot->data, bot_x);
+	forget_widths(bot);
 
 	/* Remove all text before top_x at the top of the partition. */
 	charmove(top->data, top->data + top_x, strlen(top->data) - top_x + 1);
 	align(&top->data);
+	forget_widths(top);
 
 	/* Return the partition. */
 	return p;
@@ -226,10 +444,19 @@ partition *partition_filestruct(filestruct *top, size_t top_x, filestruct *bot,
  * at (filebot, strlen(filebot->data)) again. */
 void unpartition_filestruct(partition **p)
 {
+	filestruct *top, *line;
 	char *tmp;
 
 	assert(p != NULL && openfile->fileage != NULL && openfile->filebot != NULL);
 
+	/* Take the lines of the partition out of their stretches, so that
+	 * they will all be renumbered below, whether or not they have been
+	 * renumbered inside the partition. */
+	top = openfile->fileage;
+	for (line = top; line != NULL; line = line->next) {
+		line->lineno = (ssize_t)line->lineno;
+	}
+
 	/* Reattach the line above the top of the partition, and restore the
 	 * text before top_x from top_data.  Free top_data when we're done
 	 * with it. */
@@ -243,6 +470,7 @@ void unpartition_filestruct(partition **p)
 	free((*p)->top_data);
 	strcat(openfile->fileage->data, tmp);
 	free(tmp);
+	forget_widths(openfile->fileage);
 
 	/* Reattach the line below the bottom of the partition, and restore
 	 * the text after bot_x from bot_data.  Free bot_data when we're
@@ -254,6 +482,7 @@ void unpartition_filestruct(partition **p)
 	openfile->filebot->data = charealloc(openfile->filebot->data, strlen(openfile->filebot->data) + strlen((*p)->bot_data) + 1);
 	strcat(openfile->filebot->data, (*p)->bot_data);
 	free((*p)->bot_data);
+	forget_widths(openfile->filebot);
 
 	/* Restore the top and bottom of the filestruct, if they were
 	 * different from the top and bottom of the partition. */
@@ -267,6 +496,8 @@ void unpartition_filestruct(partition **p)
 	/* Uninitialize the partition. */
 	free(*p);
 	*p = NULL;
+
+	renumber(top);
 }
 
 /* Move all the text between (top, top_x) and (bot, bot_x) in the
@@ -325,6 +556,7 @@ void move_to_filestruct(filestruct **file_top, filestruct **file_bot, filestruct
 		 * file_bot. */
 		(*file_bot)->data = charealloc((*file_bot)->data, strlen((*file_bot)->data) + strlen(openfile->fileage->data) + 1);
 		strcat((*file_bot)->data, openfile->fileage->data);
+		forget_widths(*file_bot);
 
 		/* Attach the line after top to the line after file_bot.  Then,
 		 * if there's more than one line after top, move file_bot down
@@ -543,7 +775,7 @@ void die(const char *msg, ...)
 
 	/* Save all of the other modified file buffers, if any. */
 	if (openfile != openfiles.end()) {
-		for (auto file : openfiles) {
+		for (auto& file : openfiles) {
 			/* Save the current file buffer if it's been modified. */
 			if (file.modified) {
 				die_save_file(file.filename, file.current_stat);
@@ -1266,8 +1498,8 @@ void do_input(void)
 					}
 				} else {
 					s->scfunc();
-					if (f && !f->viewok && openfile->syntax != NULL && openfile->syntax->nmultis > 0) {
-						reset_multis(openfile->current, false);
+					if (f && !f->viewok) {
+						reset_multis(openfile->current->lineno);
 					}
 					if (edit_refresh_needed) {
 						DEBUG_LOG("running edit_refresh() as edit_refresh_needed is true");
@@ -1286,116 +1518,20 @@ void do_input(void)
 	}
 }
 
-void alloc_multidata_if_needed(filestruct *fileptr)
-{
-	DEBUG_LOG("alloc_multidata_if_needed");
-	if (fileptr->multidata.empty()) {
-		DEBUG_LOG("Resizing multidata to size " << openfile->syntax->nmultis);
-		fileptr->multidata.resize(openfile->syntax->nmultis);
-	}
-}
-
-/* Precalculate the multi-line start and end regex info so we can speed up
-   rendering (with any hope at all...) */
+/* Start working out in the background which multi-line regexes are open
+ * at the start of each line of the current buffer, so that showing a part
+ * of it far down doesn't have to do all of that first.  The results are
+ * picked up by collect_multicolorinfo() as they come in. */
 void precalc_multicolorinfo(void)
 {
 	DEBUG_LOG("entering precalc_multicolorinfo()");
-	if (!openfile->colorstrings.empty() && !ISSET(NO_COLOR_SYNTAX)) {
-		regmatch_t startmatch, endmatch;
-		filestruct *fileptr, *endptr;
-		time_t last_check = time(NULL), cur_check = 0;
-
-		/* Let us get keypresses to see if the user is trying to
-		   start editing.  We may want to throw up a statusbar
-		   message before starting this later if it takes
-		   too long to do this routine.  For now silently
-		   abort if they hit a key */
-		for (auto tmpcolor : openfile->colorstrings) {
-
-			/* If it's not a multi-line regex, amscray */
-			if (tmpcolor->end == NULL) {
-				continue;
-			}
-			DEBUG_LOG("working on color id " << tmpcolor->id);
-
-			for (fileptr = openfile->fileage; fileptr != NULL; fileptr = fileptr->next) {
-				int startx = 0;
-				int nostart = 0;
-
-				DEBUG_LOG("working on lineno " << fileptr->lineno);
-
-				alloc_multidata_if_needed(fileptr);
-
-				if ((cur_check = time(NULL)) - last_check > 1) {
-					last_check = cur_check;
-					if (keyboard->has_input()) {
-						return;
-					}
-				}
-
-				while ((nostart = regexec(tmpcolor->start, &fileptr->data[startx], 1, &startmatch, (startx == 0) ? 0 : REG_NOTBOL)) == 0) {
-					/* Look for end and start marking how many lines are encompassed
-					   whcih should speed up rendering later */
-					startx += startmatch.rm_eo;
-					DEBUG_LOG("match found at pos " << startx);
-
-					/* Look on this line first for end */
-					if (regexec(tmpcolor->end, &fileptr->data[startx], 1, &endmatch, (startx == 0) ? 0 : REG_NOTBOL) == 0) {
-						startx += endmatch.rm_eo;
-						fileptr->multidata[tmpcolor->id] |= CSTARTENDHERE;
-						DEBUG_LOG("end found on this line");
-						continue;
-					}
-
-					/* Nice, we didn't find the end regex on this line.  Let's start looking for it */
-					for (endptr = fileptr->next; endptr != NULL; endptr = endptr->next) {
-
-						DEBUG_LOG("advancing to line " << endptr->lineno << " to find end...");
-						/* Check for keyboard input again */
-						if ((cur_check = time(NULL)) - last_check > 1) {
-							last_check = cur_check;
-							if (keyboard->has_input()) {
-								return;
-							}
-						}
-						if (regexec(tmpcolor->end, endptr->data, 1, &endmatch, 0) == 0) {
-							break;
-						}
-					}
-
-					if (endptr == NULL) {
-						DEBUG_LOG("no end found, breaking out");
-						break;
-					}
-
 
-					DEBUG_LOG("end found");
+	delete openfile->precalc;
+	openfile->precalc = NULL;
 
-					/* We found it, we found it, la la la la la.  Mark all the
-					lines in between and the ends properly */
-					fileptr->multidata[tmpcolor->id] |= CENDAFTER;
-					DEBUG_LOG("marking line " << fileptr->lineno << " as CENDAFTER");
-					for (fileptr = fileptr->next; fileptr != endptr; fileptr = fileptr->next) {
-						alloc_multidata_if_needed(fileptr);
-						fileptr->multidata[tmpcolor->id] = CWHOLELINE;
-						DEBUG_LOG("marking intermediary line " << fileptr->lineno << " as CWHOLELINE");
-					}
-					alloc_multidata_if_needed(endptr);
-					DEBUG_LOG("marking line " << fileptr->lineno << " as CBEGINBEFORE");
-					fileptr->multidata[tmpcolor->id] = CBEGINBEFORE;
-					/* We should be able to skip all the way to the line of the match.
-					This may introduce more bugs but it's the Right Thing to do */
-					fileptr = endptr;
-					startx = endmatch.rm_eo;
-					DEBUG_LOG("jumping to line " << endptr->lineno << " pos " << startx << " to continue");
-				}
-				if (nostart && startx == 0) {
-					DEBUG_LOG("no start found on line " << fileptr->lineno << ", continuing");
-					fileptr->multidata[tmpcolor->id] = CNONE;
-					continue;
-				}
-			}
-		}
+	if (!openfile->colorstrings.empty() && !ISSET(NO_COLOR_SYNTAX) && openfile->syntax != NULL && openfile->syntax->nmultis > 0) {
+		openfile->precalc = new HighlightScan(openfile->fileage, openfile->colorstrings);
+		openfile->precalc_valid = openfile->filebot->lineno + 1;
 	}
 }
 
@@ -1412,7 +1548,9 @@ void do_output(const std::string& output, bool allow_cntrls)
 void do_output(char *output, size_t output_len, bool allow_cntrls)
 {
 	size_t current_len, orig_lenpt = 0, i = 0;
-	char *char_buf = charalloc(mb_cur_max());
+	size_t run_start, run_len, run_chars;
+	/* Where the run of characters we insert in one go starts, how many
+	 * bytes it has, and how many characters. */
 	int char_buf_len;
 
 	assert(openfile->current != NULL && openfile->current->data != NULL);
@@ -1439,7 +1577,7 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 		}
 
 		/* Interpret the next multibyte character. */
-		char_buf_len = parse_mbchar(output + i, char_buf, NULL);
+		char_buf_len = parse_mbchar(output + i, NULL, NULL);
 
 		i += char_buf_len;
 
@@ -1449,6 +1587,53 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 			continue;
 		}
 
+		run_start = i - char_buf_len;
+		run_len = char_buf_len;
+		run_chars = 1;
+
+		/* If we're not wrapping text, nothing can happen to the line
+		 * between one character and the next, so take in all the
+		 * characters up to the next newline or filtered control
+		 * character, and grow and shift the line only once for them.
+		 * If we are wrapping, the same goes for characters added at
+		 * the end of the line as long as it stays short enough not to
+		 * be wrapped. */
+		if (ISSET(NO_WRAP) || openfile->current_x == current_len) {
+			size_t col = 0;
+
+			if (!ISSET(NO_WRAP)) {
+				col = strlenpt(openfile->current->data);
+				parse_mbchar(output + run_start, NULL, &col);
+			}
+
+			while (i < output_len && (ISSET(NO_WRAP) || (ssize_t)col <= fill)) {
+				if (allow_cntrls) {
+					if (output[i] == '\0') {
+						output[i] = '\n';
+					} else if (output[i] == '\n') {
+						break;
+					}
+				} else if (is_ascii_cntrl_char(output[i])) {
+					break;
+				}
+
+				if (!ISSET(NO_WRAP)) {
+					size_t next_col = col;
+
+					parse_mbchar(output + i, NULL, &next_col);
+					if ((ssize_t)next_col > fill) {
+						break;
+					}
+					col = next_col;
+				}
+
+				char_buf_len = parse_mbchar(output + i, NULL, NULL);
+				i += char_buf_len;
+				run_len += char_buf_len;
+				run_chars++;
+			}
+		}
+
 		/* If the NO_NEWLINES flag isn't set, when a character is
 		 * added to the magicline, it means we need a new magicline. */
 		if (!ISSET(NO_NEWLINES) && openfile->filebot == openfile->current) {
@@ -1456,27 +1641,27 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 		}
 
 		/* More dangerousness fun =) */
-		openfile->current->data = charealloc(openfile->current->data, current_len + (char_buf_len * 2));
+		openfile->current->data = charealloc(openfile->current->data, current_len + run_len + 1);
 
 		assert(openfile->current_x <= current_len);
 
-		charmove(openfile->current->data + openfile->current_x +
-		         char_buf_len, openfile->current->data +
-		         openfile->current_x, current_len - openfile->current_x +
-		         char_buf_len);
-		strncpy(openfile->current->data + openfile->current_x, char_buf, char_buf_len);
-		current_len += char_buf_len;
-		openfile->totsize++;
+		charmove(openfile->current->data + openfile->current_x + run_len,
+		         openfile->current->data + openfile->current_x,
+		         current_len - openfile->current_x + 1);
+		strncpy(openfile->current->data + openfile->current_x, output + run_start, run_len);
+		forget_widths(openfile->current);
+		current_len += run_len;
+		openfile->totsize += run_chars;
 		set_modified();
 
 		add_undo(ADD);
 
 		/* Note that current_x has not yet been incremented. */
 		if (openfile->mark_set && openfile->current == openfile->mark_begin && openfile->current_x < openfile->mark_begin_x) {
-			openfile->mark_begin_x += char_buf_len;
+			openfile->mark_begin_x += run_len;
 		}
 
-		openfile->current_x += char_buf_len;
+		openfile->current_x += run_len;
 
 		update_undo(ADD);
 
@@ -1501,12 +1686,10 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 		}
 	}
 
-	free(char_buf);
-
 	openfile->placewewant = xplustabs();
 
 
-	reset_multis(openfile->current, false);
+	reset_multis(openfile->current->lineno);
 	if (edit_refresh_needed == true) {
 		edit_refresh();
 		edit_refresh_needed = false;
@@ -1929,10 +2112,6 @@ int main(int argc, char **argv)
 
 	DEBUG_LOG("Main: top and bottom win");
 
-	if (openfile->syntax && openfile->syntax->nmultis > 0) {
-		precalc_multicolorinfo();
-	}
-
 	if (startline > 0 || startcol > 0) {
 		do_gotolinecolumn(startline, startcol, false, false, false, false);
 	} else {
@@ -1972,6 +2151,38 @@ int main(int argc, char **argv)
 
 		currmenu = MMAIN;
 
+		/* While the highlighting is being worked out in the background,
+		 * show its results as they come in, until a key is pressed. */
+		while (openfile->precalc != NULL && !keyboard->wait_for_input(HIGHLIGHT_SCAN_POLL)) {
+			if (collect_multicolorinfo()) {
+				edit_refresh();
+				reset_cursor();
+				wnoutrefresh(edit);
+				doupdate();
+			}
+		}
+
+		/* Likewise, take up the index of search matches once it's done,
+		 * and keep it up to date while the matches are highlighted. */
+		while (match_index_pending() && !keyboard->wait_for_input(MATCH_INDEX_POLL)) {
+			if (collect_match_index()) {
+				edit_refresh();
+				reset_cursor();
+				wnoutrefresh(edit);
+				doupdate();
+			}
+		}
+		forget_match_count();
+
+		/* A background scan or index may still be copying the lines, and
+		 * the key may change them. */
+		if (openfile->precalc != NULL) {
+			openfile->precalc->wait_for_copy();
+		}
+		if (openfile->matches != NULL) {
+			openfile->matches->wait_for_copy();
+		}
+
 		/* Read in and interpret characters. */
 		do_input();
 	}
@@ -33,7 +33,15 @@
 
 #include "History.h"
 #include "Keyboard.h"
+#include "NodePool.h"
 #include "OpenFile.h"
+#include "WorkerPool.h"
+#include "HighlightScan.h"
+#include "LiteralSearch.h"
+#include "MatchIndex.h"
+#include "BracketIndex.h"
+#include "LineWriter.h"
+#include "lines.h"
 #include "cpputil.h"
 
 #ifdef NEED_XOPEN_SOURCE_EXTENDED
@@ -127,6 +135,11 @@
 #define getline ngetline
 #endif
 
+/* Without REG_STARTEND, regexec() just goes by the terminating null. */
+#ifndef REG_STARTEND
+#define REG_STARTEND 0
+#endif
+
 #include "syntax.h"
 
 /* The elements of the interface that can be colored differently. */
@@ -173,7 +186,9 @@ enum {
 	QUIET,
 	SOFTWRAP,
 	POS_HISTORY,
-	LOCKING
+	LOCKING,
+	HIGHLIGHT_MATCHES,
+	ATOMIC_SAVE
 };
 
 /* Flags for which menus in which a given function should be present */
@@ -227,6 +242,57 @@ enum {
 /* The maximum number of bytes buffered at one time. */
 #define MAX_BUF_SIZE 128
 
+/* The number of bytes we read() at a time from a file we can't map
+ * into memory. */
+#define READ_BLOCK_SIZE 65536
+
+/* The number of bytes of lines we gather before writing them out when
+ * saving a file. */
+#define WRITE_BLOCK_SIZE 1048576
+
+/* The number of bytes we copy at a time from one file to another. */
+#define COPY_BLOCK_SIZE 1048576
+
+/* The size of the slabs that line nodes are carved out of.  It must be
+ * a power of two. */
+#define NODE_SLAB_BYTES 1048576
+
+/* The most lines in one of the stretches that a buffer's lines are
+ * numbered by. */
+#define LINE_INDEX_STRIDE 256
+
+/* The number of bytes of lines that a regex search tries in one go
+ * before looking at them one at a time.  It starts with a small batch,
+ * so that nearby matches don't cost a big one, and doubles it each time
+ * nothing is found. */
+#define SEARCH_BATCH_MIN 1024
+#define SEARCH_BATCH_SIZE 65536
+
+/* A search that has at least this many lines left to go through splits
+ * them up between threads, and looks for a keystroke to cancel it every
+ * PARALLEL_SEARCH_POLL milliseconds meanwhile. */
+#define PARALLEL_SEARCH_MIN 100000
+#define PARALLEL_SEARCH_POLL 20
+
+/* Lines of at least this many bytes keep their display widths in a
+ * width cache, with an entry every WIDTH_INDEX_STRIDE bytes. */
+#define WIDTH_CACHE_MIN 1024
+#define WIDTH_INDEX_STRIDE 256
+
+/* How long, in milliseconds, to wait for a key before picking up what a
+ * background highlighting scan has worked out in the meantime. */
+#define HIGHLIGHT_SCAN_POLL 50
+
+/* How long, in milliseconds, to wait for a key before looking whether the
+ * index of search matches is done, or should be brought up to date. */
+#define MATCH_INDEX_POLL 50
+
+/* How long, in milliseconds, typing at the search prompt has to pause
+ * before what has been typed so far is searched for, and after trying
+ * how many lines that search looks whether another key has come in. */
+#define TYPED_SEARCH_DELAY 150
+#define TYPED_SEARCH_CHECK 4096
+
 /* Some exit codes that we might want to check for. */
 #define COMMAND_FAILED_PERMISSION_DENIED 126
 #define COMMAND_FAILED_NOT_FOUND 127
@@ -533,6 +533,8 @@ FunctionPtr get_prompt_string(std::shared_ptr<Key>& actual, bool allow_tabs, boo
 	/* The current history string. */
 	std::string magichistory;
 	/* The temporary string typed at the bottom of the history, if any. */
+	std::string searched;
+	/* What was last searched for as it was typed, at the search prompt. */
 	size_t complete_len = 0;
 	/* The length of the original string that we're trying to
 	 * tab complete, if any. */
@@ -567,6 +569,15 @@ FunctionPtr get_prompt_string(std::shared_ptr<Key>& actual, bool allow_tabs, boo
 	wnoutrefresh(bottomwin);
 
 	while (1) {
+		/* At the search prompt, once the typing pauses, search for what
+		 * has been typed so far. */
+		if (currmenu == MWHEREIS && answer != searched && !keyboard->wait_for_input(TYPED_SEARCH_DELAY)) {
+			searched = answer;
+			search_as_typed();
+			reset_statusbar_cursor();
+			wnoutrefresh(bottomwin);
+		}
+
 		kbinput = std::make_shared<Key>(do_statusbar_input(&ran_func, &finished, refresh_func));
 		assert(statusbar_x <= answer.length());
 
@@ -58,6 +58,9 @@ extern bool nodelay_mode;
 extern std::string answer;
 
 extern ssize_t tabsize;
+extern size_t text_changes;
+extern ssize_t undo_limit;
+extern ssize_t large_file_limit;
 
 extern std::string backup_dir;
 extern const std::string locking_prefix;
@@ -130,6 +133,8 @@ int mbwidth(const char *c);
 int mb_cur_max(void);
 char *make_mbchar(long chr, int *chr_mb_len);
 int parse_mbchar(const char *buf, char *chr, size_t *col);
+size_t printable_ascii_len(const char *s);
+bool ascii_only(const char *s, size_t len);
 size_t move_mbleft(const std::string& str, size_t pos);
 size_t move_mbleft(const char *buf, size_t pos);
 size_t move_mbright(const std::string& str, size_t pos);
@@ -163,6 +168,13 @@ bool is_valid_mbstring(const char *s);
 void set_colorpairs(void);
 void color_init(void);
 void color_update(void);
+void reset_multis(ssize_t lineno);
+size_t text_hash(const char *text, size_t *len);
+void multi_state(const char *text, size_t len, const ColorList& colors, const unsigned char *prev_state, unsigned char *state);
+linecolors *check_multis(filestruct *fileptr);
+linecolors *highlight_line(filestruct *fileptr, size_t endpos);
+bool collect_multicolorinfo(void);
+bool multi_ends_later(const filestruct *fileptr, size_t index, const ColorPtr& color);
 
 /* All functions in cut.c. */
 void cutbuffer_reset(void);
@@ -188,8 +200,14 @@ std::list<OpenFile>::iterator switch_to_prevnext_buffer(bool next, bool quiet=fa
 void switch_to_prev_buffer_void(void);
 void switch_to_next_buffer_void(void);
 bool close_buffer(bool quiet);
-filestruct *read_line(char *buf, filestruct *prevnode, bool *first_line_ins, size_t buf_len);
-void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool checkwritable);
+filestruct *read_line(const char *buf, filestruct *prevnode, bool *first_line_ins, size_t buf_len);
+char *load_file_contents(FILE *f, const std::string& filename, size_t *size, bool *mapped);
+size_t file_part_size(void);
+void find_file_part(const char *contents, size_t len);
+void read_file(FILE *f, int fd, const std::string& filename, bool undoable, bool checkwritable, bool windowed=false);
+void load_file_part(bool previous);
+void do_next_part(void);
+void do_prev_part(void);
 int open_file(const std::string& filename, bool newfie, bool quiet, FILE **f);
 std::string get_next_filename(const std::string& name, const std::string& suffix);
 void do_insertfile(bool execute);
@@ -201,6 +219,8 @@ std::string safe_tempfile(FILE **f);
 void init_backup_dir(void);
 int delete_lockfile(const std::string& lockfilename);
 int write_lockfile(const std::string& lockfilename, const std::string& origfilename, bool modified);
+size_t copy_block(off_t len, size_t copied);
+int copy_fd(int in_fd, int out_fd, off_t len);
 int copy_file(FILE *inn, FILE *out);
 bool write_file(const std::string& name, FILE *f_open, bool tmp, AppendType append, bool nonamechange);
 bool write_marked_file(const std::string& name, FILE *f_open, bool tmp, AppendType append);
@@ -267,7 +287,11 @@ void unlink_node(const filestruct *fileptr);
 void delete_node(filestruct *fileptr);
 filestruct *copy_filestruct(const filestruct *src);
 void free_filestruct(filestruct *src);
+void release_filestruct(filestruct *src, NodePool *pool);
 void renumber(filestruct *fileptr);
+void renumber_chunks(filestruct *fileptr);
+void forget_line_chunks(void);
+filestruct *indexed_line(ssize_t lineno);
 partition *partition_filestruct(filestruct *top, size_t top_x, filestruct *bot, size_t bot_x);
 void unpartition_filestruct(partition **p);
 void move_to_filestruct(filestruct **file_top, filestruct **file_bot, filestruct *top, size_t top_x, filestruct *bot, size_t bot_x);
@@ -305,6 +329,7 @@ void disable_flow_control(void);
 void enable_flow_control(void);
 void terminal_init(void);
 void do_input(void);
+void precalc_multicolorinfo(void);
 void do_output(const std::string& output, bool allow_cntrls);
 void do_output(char *output, size_t output_len, bool allow_cntrls);
 
@@ -346,8 +371,6 @@ void parse_include(char *ptr);
 COLORWIDTH color_name_to_value(std::string colorname, bool *bright, bool *underline);
 void parse_colors(char *ptr, bool icase);
 bool parse_color_names(const std::string& combostr, short *fg, short *bg, bool *bright, bool *underline);
-void reset_multis(filestruct *fileptr, bool force);
-void alloc_multidata_if_needed(filestruct *fileptr);
 void parse_rcfile(std::ifstream &rcstream, bool syntax_only);
 void do_rcfile(void);
 
@@ -358,12 +381,23 @@ void not_found_msg(const std::string& str);
 void not_found_msg(const char *str);
 void search_replace_abort(void);
 int search_init(bool replacing, bool use_answer);
+filestruct *skip_to_regex_match(filestruct *fileptr, const filestruct *stop, ssize_t *current_y);
+filestruct *parallel_search(WorkerPool *workers, filestruct *fileptr, const filestruct *stop, const char *needle, ssize_t *current_y);
+void index_matches(const char *needle);
+bool match_index_pending(void);
+bool collect_match_index(void);
+void forget_match_count(void);
+filestruct *skip_to_indexed_match(filestruct *fileptr, const filestruct *stop, ssize_t *current_y);
 bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x, const std::string& needle, size_t *needle_len);
 bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x, const char *needle, size_t *needle_len);
 void findnextstr_wrap_reset(void);
+void start_typed_search(void);
+void search_as_typed(void);
+void end_typed_search(bool entered);
 void do_search(void);
 void do_research(void);
 int replace_regexp(char *string, bool create);
+size_t regexp_replacement(const char *match, char *string);
 char *replace_line(const char *needle);
 ssize_t do_replace_loop(bool whole_word_only, bool *canceled, const filestruct *real_current, size_t *real_current_x, const char *needle);
 void do_replace(void);
@@ -371,7 +405,7 @@ void do_gotolinecolumn(ssize_t line, ssize_t column, bool use_answer, bool inter
 void do_gotolinecolumn_void(void);
 void do_gotopos(ssize_t pos_line, size_t pos_x, ssize_t pos_y, size_t pos_pww);
 void goto_line_posx(ssize_t line, size_t pos_x);
-bool find_bracket_match(bool reverse, const char *bracket_set);
+void goto_fileptr_posx(filestruct *line, size_t pos_x);
 void do_find_bracket(void);
 void get_history_older_void(void);
 void get_history_newer_void(void);
@@ -384,8 +418,13 @@ void do_tab(void);
 void do_indent(ssize_t cols);
 void do_indent_void(void);
 void do_unindent(void);
+void swap_replaced_lines(undo *u, bool undoing);
+void swap_replaced_text(undo *u, filestruct *f);
+void insert_into_line(filestruct *f, size_t x, const char *s);
+void remove_from_line(filestruct *f, size_t x, size_t len);
 void do_undo(void);
 void do_redo(void);
+void do_undo_usage(void);
 void do_enter(bool undoing);
 void do_enter_void(void);
 void cancel_command(int signal);
@@ -414,7 +453,6 @@ void null_at(char **data, size_t index);
 void unsunder(std::string& str);
 void unsunder(char *str, size_t true_len);
 void sunder(std::string& str);
-void sunder(char *str);
 #ifndef HAVE_GETLINE
 ssize_t ngetline(char **lineptr, size_t *n, FILE *stream);
 #endif
@@ -425,6 +463,7 @@ ssize_t getdelim(char **lineptr, size_t *n, char delim, std::istream &stream);
 ssize_t getline(char **lineptr, size_t *n, std::istream &stream);
 bool is_whole_word(size_t pos, const char *buf, const char *word);
 const char *strstrwrapper(const char *haystack, const char *needle, const char *start);
+const char *last_regex_match(const char *haystack, const char *start);
 void nperror(const char *s);
 void *nmalloc(size_t howmuch);
 void *nrealloc(void *ptr, size_t howmuch);
@@ -433,15 +472,28 @@ char *mallocstrcpy(char *dest, const char *src);
 size_t get_page_start(size_t column);
 size_t xplustabs(void);
 size_t actual_x(const char *s, size_t column);
+size_t actual_x_from(const char *s, size_t column, size_t len);
 size_t strnlenpt(const char *s, size_t maxlen);
+size_t strnlenpt_from(const char *s, size_t maxlen, size_t len);
 size_t strlenpt(const char *s);
+widthcache *line_widths(filestruct *fileptr);
+void forget_widths(filestruct *fileptr);
+size_t line_strlenpt(filestruct *fileptr);
+size_t line_strnlenpt(filestruct *fileptr, size_t maxlen);
+size_t line_actual_x(filestruct *fileptr, size_t column);
 void new_magicline(void);
 void remove_magicline(void);
 void mark_order(const filestruct **top, size_t *top_x, const filestruct **bot, size_t *bot_x, bool *right_side_up);
+size_t undo_item_size(const undo *u);
+void recount_undo(undo *u);
+void free_undo(undo *u);
+void trim_undo_history(void);
 void add_undo(UndoType _action);
 void update_undo(UndoType action);
 size_t get_totsize(const filestruct *begin, const filestruct *end);
+size_t count_words(const filestruct *begin, const filestruct *end);
 filestruct *fsfromline(ssize_t lineno);
+filestruct *line_from_number(ssize_t lineno);
 #ifdef DEBUG
 void dump_filestruct(const filestruct *inptr);
 void dump_filestruct_reverse(void);
@@ -461,6 +513,8 @@ void blank_bottombars(void);
 void check_statusblank(void);
 std::string display_string(const std::string& buf, size_t start_col, size_t len, bool dollars);
 char *display_string(const char *buf, size_t start_col, size_t len, bool dollars);
+char *display_string(filestruct *fileptr, size_t start_col, size_t len, bool dollars);
+char *display_string_from(const char *buf, size_t start_index, size_t column, size_t start_col, size_t len, bool dollars);
 void titlebar(const std::string& path);
 void titlebar(const char *path);
 void set_modified(void);
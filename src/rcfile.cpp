@@ -40,6 +40,7 @@ std::vector<rcoption> rcopts = {
 	{"boldtext", BOLD_TEXT, false},
 	{"const", CONST_UPDATE, false},
 	{"fill", 0, true},
+	{"largefile", 0, false},
 	{"locking", LOCKING, false},
 	{"multibuffer", MULTIBUFFER, false},
 	{"morespace", MORE_SPACE, false},
@@ -54,14 +55,17 @@ std::vector<rcoption> rcopts = {
 	{"suspend", SUSPEND, false},
 	{"tabsize", 0, true},
 	{"tempfile", TEMP_FILE, false},
+	{"undolimit", 0, false},
 	{"view", VIEW_MODE, false},
 	{"autoindent", AUTOINDENT, true},
 	{"backup", BACKUP_FILE, false},
 	{"allow_insecure_backup", INSECURE_BACKUP, false},
+	{"atomicsave", ATOMIC_SAVE, false},
 	{"backupdir", 0, false},
 	{"backwards", BACKWARDS_SEARCH, false},
 	{"casesensitive", CASE_SENSITIVE, false},
 	{"cut", CUT_TO_END, false},
+	{"highlightmatches", HIGHLIGHT_MATCHES, false},
 	{"historylog", HISTORYLOG, false},
 	{"matchbrackets", 0, true},
 	{"noconvert", NO_CONVERT, false},
@@ -1108,6 +1112,16 @@ void parse_rcfile(std::ifstream &rcstream, bool syntax_only)
 								rcfile_error(N_("Requested tab size \"%s\" is invalid"), argument.c_str());
 								tabsize = -1;
 							}
+						} else if (rcopt.name == "undolimit") {
+							if (!parse_num(argument.c_str(), &undo_limit) || undo_limit < 0) {
+								rcfile_error(N_("Requested undo limit \"%s\" is invalid"), argument.c_str());
+								undo_limit = 0;
+							}
+						} else if (rcopt.name == "largefile") {
+							if (!parse_num(argument.c_str(), &large_file_limit) || large_file_limit < 0) {
+								rcfile_error(N_("Requested large file limit \"%s\" is invalid"), argument.c_str());
+								large_file_limit = 0;
+							}
 						} else {
 							assert(false);
 						}
@@ -28,11 +28,64 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <algorithm>
+#include <atomic>
 
 static bool search_last_line = false;
 /* Have we gone past the last line while searching? */
 static bool regexp_compiled = false;
 /* Have we compiled any regular expressions? */
+static regex_t batch_regexp;
+/* The search regex again, compiled to match in many lines at once. */
+static bool batch_compiled = false;
+/* Can we search with batch_regexp? */
+static bool search_wrapped = false;
+/* Did the last search go past an end of the buffer? */
+static bool count_wanted = false;
+/* Should the match count be shown once the index of matches is done? */
+static ssize_t count_lineno;
+static size_t count_x;
+/* Where the match was that the count is wanted for. */
+static bool typing_search = false;
+/* Is the search being run on what is being typed at the search prompt?
+ * Then it keeps quiet, and gives up as soon as another key comes in. */
+static bool search_interrupted = false;
+/* Did the last search give up because of that? */
+static bool search_at_cursor = false;
+/* May the search find a match right where the cursor is? */
+static filestruct *typed_from = NULL, *typed_edittop;
+static size_t typed_from_x, typed_pww;
+static ssize_t typed_from_y;
+/* Where the cursor and the edit window were when the prompt came up. */
+static std::string typed_needle;
+/* What the cursor is on a match of, as far as it was searched for while
+ * typing, or "" if the cursor is at typed_from. */
+static bool typed_wrapped;
+/* Whether that match lies beyond an end of the buffer. */
+static bool typed_match_kept = false;
+/* Was the prompt left on the match of what was typed, so that the
+ * search needn't be done again? */
+
+/* Return true if regexp matches in lines joined by newlines where, and
+ * only where, it matches in the lines on their own, give or take matches
+ * that cross from one line into the next.  Anchors for the start or end
+ * of the whole string, lookarounds and other (? and (* constructs might
+ * not, so those are only ever tried one line at a time. */
+static bool batchable_regexp(const char *regexp)
+{
+	for (const char *c = regexp; *c != '\0'; c++) {
+		if (*c == '\\' && c[1] != '\0') {
+			if (strchr("AzZG`'", c[1]) != NULL) {
+				return false;
+			}
+			c++;
+		} else if (*c == '(' && (c[1] == '?' || c[1] == '*')) {
+			return false;
+		}
+	}
+
+	return true;
+}
 
 /* Compile the regular expression regexp to see if it's valid.  Return
  * true if it is, or false otherwise. */
@@ -57,6 +110,10 @@ bool regexp_init(const char *regexp)
 
 	regexp_compiled = true;
 
+	if (batchable_regexp(regexp)) {
+		batch_compiled = (regcomp(&batch_regexp, regexp, REG_EXTENDED | REG_NEWLINE | (ISSET(CASE_SENSITIVE) ? 0 : REG_ICASE)) == 0);
+	}
+
 	return true;
 }
 
@@ -68,6 +125,10 @@ void regexp_cleanup(void)
 		regexp_compiled = false;
 		regfree(&search_regexp);
 	}
+	if (batch_compiled) {
+		batch_compiled = false;
+		regfree(&batch_regexp);
+	}
 }
 
 /* Indicate on the statusbar that the string at str was not found by the
@@ -142,6 +203,10 @@ int search_init(bool replacing, bool use_answer)
 		buf = mallocstrcpy(NULL, "");
 	}
 
+	if (!replacing) {
+		start_typed_search();
+	}
+
 	/* This is now one simple call.  It just does a lot. */
 	PromptResult i = do_prompt(false,
 	              true,
@@ -162,6 +227,10 @@ int search_init(bool replacing, bool use_answer)
 
 	backupstring = "";
 
+	if (!replacing) {
+		end_typed_search(i == PROMPT_ENTER_PRESSED);
+	}
+
 	/* Cancel any search, or just return with no previous search. */
 	if (i == PROMPT_ABORTED || (i == PROMPT_BLANK_STRING && last_search == "") || (!replacing && i == PROMPT_ENTER_PRESSED && answer == "")) {
 		statusbar(_("Cancelled"));
@@ -201,6 +270,416 @@ int search_init(bool replacing, bool use_answer)
 	return 0;
 }
 
+/* Starting at fileptr, and going in the search direction up to but not
+ * past stop or either end of the buffer, join lines up and run the
+ * search regex over them at once, in batches that grow from
+ * SEARCH_BATCH_MIN to SEARCH_BATCH_SIZE bytes until one holds a match or
+ * SEARCH_BATCH_SIZE bytes have been tried in all.  fileptr itself is
+ * tried alone first, since the match is very often right there.  Return
+ * the first line in the search direction where a match may start, or
+ * the last line tried if there is none, and count the lines we moved
+ * over in current_y.  Matches found this way can run from one line into
+ * the next, so the line we return still has to be searched on its own;
+ * lines holding nulls, which are stored as newlines, are never joined. */
+filestruct *skip_to_regex_match(filestruct *fileptr, const filestruct *stop, ssize_t *current_y)
+{
+	bool backwards = ISSET(BACKWARDS_SEARCH);
+	std::vector<filestruct *> lines;
+	std::vector<size_t> offsets;
+	std::string batch;
+	filestruct *line = fileptr, *result = fileptr;
+	size_t budget = SEARCH_BATCH_MIN, tried = 0;
+
+	if (strchr(fileptr->data, '\n') != NULL || regexec(&batch_regexp, fileptr->data, 0, NULL, 0) == 0) {
+		return fileptr;
+	}
+
+	while (tried < SEARCH_BATCH_SIZE) {
+		size_t bytes = 0;
+
+		lines.clear();
+		for (; line != NULL && line != stop && bytes < budget; line = backwards ? prev_line(line) : next_line(line)) {
+			size_t len = strlen(line->data);
+
+			if (memchr(line->data, '\n', len) != NULL) {
+				break;
+			}
+
+			lines.push_back(line);
+			bytes += len + 1;
+		}
+
+		if (lines.empty()) {
+			break;
+		}
+
+		/* Join the lines in the order they are in the buffer. */
+		if (backwards) {
+			std::reverse(lines.begin(), lines.end());
+		}
+		batch.clear();
+		offsets.clear();
+		batch.reserve(bytes);
+		for (filestruct *joined : lines) {
+			offsets.push_back(batch.size());
+			batch += joined->data;
+			batch += '\n';
+		}
+		batch.pop_back();
+
+		/* Find the first match; going backwards, go on from the start
+		 * of the next line after each match to find the last one. */
+		ssize_t hit = -1;
+		size_t from = 0;
+		regmatch_t match;
+
+		while (from <= batch.size()) {
+			match.rm_so = 0;
+			match.rm_eo = batch.size() - from;
+
+			if (regexec(&batch_regexp, batch.c_str() + from, 1, &match, REG_STARTEND) != 0) {
+				break;
+			}
+
+			hit = std::upper_bound(offsets.begin(), offsets.end(), from + match.rm_so) - offsets.begin() - 1;
+
+			if (!backwards || hit + 1 == (ssize_t)lines.size()) {
+				break;
+			}
+
+			from = offsets[hit + 1];
+		}
+
+		if (hit >= 0) {
+			result = lines[hit];
+			break;
+		}
+
+		result = backwards ? lines.front() : lines.back();
+
+		/* A line holding nulls, the end of the buffer, or stop is in
+		 * the way. */
+		if (bytes < budget) {
+			break;
+		}
+
+		tried += bytes;
+		budget = std::min(budget * 2, (size_t)SEARCH_BATCH_SIZE);
+	}
+
+	*current_y += result->lineno - fileptr->lineno;
+
+	return result;
+}
+
+/* Read the keys typed so far, and return whether Cancel is among them.
+ * The other keys are given back to be read after the search. */
+static bool cancel_pressed()
+{
+	std::vector<Key> held;
+	bool cancel = false;
+
+	while (!cancel && keyboard->wait_for_input(0)) {
+		Key key = keyboard->get_key();
+
+		if (func_from_key(key) == do_cancel) {
+			cancel = true;
+		} else {
+			held.push_back(key);
+		}
+	}
+
+	for (const Key& key : held) {
+		keyboard->put_back(key);
+	}
+
+	return cancel;
+}
+
+/* What the threads of a parallel search share. */
+struct search_chunks {
+	const char *needle;
+	/* The string or regex we look for. */
+	const LiteralSearch *literal;
+	/* The prepared needle, when it isn't a regex. */
+	bool backwards;
+	/* Whether the chunks run towards the top of the buffer. */
+	std::vector<filestruct *> starts;
+	/* The first line of each chunk, in search order. */
+	std::vector<size_t> counts;
+	/* How many lines each chunk has. */
+	std::vector<filestruct *> found;
+	/* For each chunk, the first line in it that may hold a match. */
+	std::atomic<size_t> next_chunk;
+	/* The chunk that the next free thread should take. */
+	std::atomic<size_t> first_found;
+	/* The earliest chunk found to hold a match so far. */
+	std::atomic<bool> cancelled;
+	/* Whether the user has given up on the search. */
+};
+
+/* Take chunks of lines in search order and look for a line holding a
+ * match in each, until there are none left, or none left that come
+ * before a chunk where something was found. */
+static void search_chunks_worker(search_chunks *chunks)
+{
+	regex_t regexp;
+	bool use_regexp = ISSET(USE_REGEXP);
+
+	/* regexec() serializes calls that share a compiled regex, so each
+	 * thread compiles one of its own. */
+	if (use_regexp && regcomp(&regexp, chunks->needle, REG_EXTENDED | REG_NOSUB | (ISSET(CASE_SENSITIVE) ? 0 : REG_ICASE)) != 0) {
+		use_regexp = false;
+		chunks->cancelled = true;
+	}
+
+	for (size_t c = chunks->next_chunk++; c < chunks->starts.size() && c < chunks->first_found && !chunks->cancelled; c = chunks->next_chunk++) {
+		filestruct *line = chunks->starts[c];
+
+		for (size_t n = 0; n < chunks->counts[c] && !chunks->cancelled; n++) {
+			if (use_regexp ? regexec(&regexp, line->data, 0, NULL, 0) == 0 : chunks->literal->find(line->data) != NULL) {
+				chunks->found[c] = line;
+
+				for (size_t first = chunks->first_found; c < first && !chunks->first_found.compare_exchange_weak(first, c);) {
+					;
+				}
+				break;
+			}
+
+			line = chunks->backwards ? line->prev : line->next;
+		}
+	}
+
+	if (use_regexp) {
+		regfree(&regexp);
+	}
+}
+
+/* Starting at fileptr, and going in the search direction up to but not
+ * past stop or either end of the buffer, look for the first line that
+ * holds a match for needle, splitting the lines into chunks that are
+ * searched on the threads of workers.  Return that
+ * line, or the last line of the stretch if there is none, and count the
+ * lines we moved over in current_y.  Return NULL if the user cancelled,
+ * or typed on while searching as typed.
+ * Return fileptr itself when the stretch is too short to bother. */
+filestruct *parallel_search(WorkerPool *workers, filestruct *fileptr, const filestruct *stop, const char *needle, ssize_t *current_y)
+{
+	bool backwards = ISSET(BACKWARDS_SEARCH);
+	size_t threads = workers->size();
+	ssize_t last;
+
+	if (filepart != NULL || threads < 2) {
+		return fileptr;
+	}
+
+	if (backwards) {
+		last = (stop->lineno < fileptr->lineno) ? stop->lineno + 1 : openfile->fileage->lineno;
+	} else {
+		last = (stop->lineno > fileptr->lineno) ? stop->lineno - 1 : openfile->filebot->lineno;
+	}
+
+	size_t total = (backwards ? fileptr->lineno - last : last - fileptr->lineno) + 1;
+
+	if (total < PARALLEL_SEARCH_MIN) {
+		return fileptr;
+	}
+
+	LiteralSearch literal(needle, ISSET(CASE_SENSITIVE));
+	search_chunks chunks;
+	size_t size = std::max(total / (threads * 8), (size_t)LINE_INDEX_STRIDE);
+
+	chunks.needle = needle;
+	chunks.literal = &literal;
+	chunks.backwards = backwards;
+	for (size_t done = 0; done < total; done += size) {
+		ssize_t lineno = backwards ? fileptr->lineno - done : fileptr->lineno + done;
+
+		chunks.starts.push_back(line_from_number(lineno));
+		chunks.counts.push_back(std::min(size, total - done));
+	}
+	chunks.found.assign(chunks.starts.size(), NULL);
+	chunks.next_chunk = 0;
+	chunks.first_found = chunks.starts.size();
+	chunks.cancelled = false;
+
+	workers->start([&chunks] { search_chunks_worker(&chunks); });
+
+	/* Wait for the threads, and let the user cancel meanwhile. */
+	while (!workers->wait_for(PARALLEL_SEARCH_POLL)) {
+		if (typing_search) {
+			if (keyboard->wait_for_input(0)) {
+				chunks.cancelled = true;
+			}
+			continue;
+		}
+
+		if (cancel_pressed()) {
+			chunks.cancelled = true;
+		}
+	}
+
+	if (chunks.cancelled) {
+		return NULL;
+	}
+
+	filestruct *result;
+
+	if (chunks.first_found < chunks.starts.size()) {
+		result = chunks.found[chunks.first_found];
+	} else {
+		result = line_from_number(last);
+	}
+
+	*current_y += result->lineno - fileptr->lineno;
+
+	return result;
+}
+
+/* Start indexing the matches of needle in the current buffer, unless
+ * that has already been done for the text as it is now. */
+void index_matches(const char *needle)
+{
+	MatchIndex *index = openfile->matches;
+
+	if (index != NULL && index->is_for(needle, ISSET(USE_REGEXP), ISSET(CASE_SENSITIVE)) && index->is_current()) {
+		return;
+	}
+
+	delete index;
+	openfile->matches = new MatchIndex(openfile->fileage, needle, ISSET(USE_REGEXP), ISSET(CASE_SENSITIVE));
+	openfile->matches_collected = false;
+}
+
+/* Return the index of matches of needle in the current buffer, if there
+ * is one that is done and still fits the text. */
+static const MatchIndex *usable_index(const char *needle)
+{
+	const MatchIndex *index = openfile->matches;
+
+	if (index == NULL || !index->complete() || !index->is_current() ||
+	        !index->is_for(needle, ISSET(USE_REGEXP), ISSET(CASE_SENSITIVE))) {
+		return NULL;
+	}
+
+	return index;
+}
+
+/* If a match count is wanted and the index can give it, tell which of
+ * the matches the cursor is on.  Return whether we did. */
+static bool show_match_count(void)
+{
+	if (!count_wanted || openfile->current->lineno != count_lineno || openfile->current_x != count_x) {
+		return false;
+	}
+
+	const MatchIndex *index = usable_index(last_search.c_str());
+
+	if (index == NULL) {
+		return false;
+	}
+
+	size_t number = index->number_of(count_lineno, count_x);
+
+	if (number > 0) {
+		if (search_wrapped) {
+			statusbar(_("Search Wrapped: match %lu of %lu"), (unsigned long)number, (unsigned long)index->count());
+		} else {
+			statusbar(_("Match %lu of %lu"), (unsigned long)number, (unsigned long)index->count());
+		}
+	}
+
+	count_wanted = false;
+
+	return (number > 0);
+}
+
+/* Ask for the match count to be shown for the match the cursor is on,
+ * now if it is known, or else once it is. */
+static void want_match_count(void)
+{
+	count_wanted = true;
+	count_lineno = openfile->current->lineno;
+	count_x = openfile->current_x;
+	show_match_count();
+}
+
+/* Return whether the main loop should keep an eye on the index of
+ * matches: while it is being made, until it has been taken notice of,
+ * and while matches are being highlighted and the text has changed. */
+bool match_index_pending(void)
+{
+	const MatchIndex *index = openfile->matches;
+
+	if (index == NULL) {
+		return false;
+	}
+
+	if (!index->complete()) {
+		return true;
+	}
+
+	return (index->is_current() ? !openfile->matches_collected : ISSET(HIGHLIGHT_MATCHES));
+}
+
+/* Take notice of a finished index of matches: show the match count if
+ * it is wanted, or start over if the text has changed in the meantime.
+ * Return whether the edit window should be redrawn. */
+bool collect_match_index(void)
+{
+	MatchIndex *index = openfile->matches;
+
+	if (index == NULL || !index->complete()) {
+		return false;
+	}
+
+	if (!index->is_current()) {
+		if (ISSET(HIGHLIGHT_MATCHES)) {
+			openfile->matches = index->renewed(openfile->fileage);
+			openfile->matches_collected = false;
+			delete index;
+		}
+		return false;
+	}
+
+	if (openfile->matches_collected) {
+		return false;
+	}
+
+	openfile->matches_collected = true;
+
+	return (show_match_count() || ISSET(HIGHLIGHT_MATCHES));
+}
+
+/* The user has gone on to something else, so a match count that isn't
+ * known yet is no longer of interest. */
+void forget_match_count(void)
+{
+	count_wanted = false;
+}
+
+/* Going from fileptr towards stop, or towards the end of the buffer if
+ * stop lies the other way, return the first line that the index has a
+ * match on, or the last line of the stretch if there is none, and count
+ * the lines we moved over in current_y. */
+filestruct *skip_to_indexed_match(filestruct *fileptr, const filestruct *stop, ssize_t *current_y)
+{
+	const MatchIndex *index = openfile->matches;
+	ssize_t last;
+
+	if (ISSET(BACKWARDS_SEARCH)) {
+		last = (stop->lineno < fileptr->lineno) ? stop->lineno + 1 : openfile->fileage->lineno;
+	} else {
+		last = (stop->lineno > fileptr->lineno) ? stop->lineno - 1 : openfile->filebot->lineno;
+	}
+
+	filestruct *result = line_from_number(index->line_with_match(fileptr->lineno, last));
+
+	*current_y += result->lineno - fileptr->lineno;
+
+	return result;
+}
+
 /* Look for needle, starting at (current, current_x). begin is the line
  * where we first started searching, at column begin_x.  The return
  * value specifies whether we found anything.  If we did, set needle_len
@@ -220,28 +699,74 @@ bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x,
 	filestruct *fileptr = openfile->current;
 	const char *rev_start = fileptr->data, *found = NULL;
 	time_t lastkbcheck = time(NULL);
+	size_t lines_tried = 0;
+	WorkerPool workers;
+	/* The threads of the parallel search, kept for the whole search. */
 
 	/* rev_start might end up 1 character before the start or after the
 	 * end of the line.  This won't be a problem because strstrwrapper()
 	 * will return immediately and say that no match was found, and
 	 * rev_start will be properly set when the search continues on the
 	 * previous or next line. */
-	if (ISSET(BACKWARDS_SEARCH)) {
+	if (search_at_cursor) {
+		rev_start += openfile->current_x;
+	} else if (ISSET(BACKWARDS_SEARCH)) {
 		rev_start += ((openfile->current_x == 0) ? -1 : move_mbleft(fileptr->data, openfile->current_x));
 	} else {
 		rev_start += move_mbright(fileptr->data, openfile->current_x);
 	}
 
+	search_wrapped = false;
+
 	/* Look for needle in the current line we're searching. */
 	enable_nodelay();
 	while (true) {
-		if (time(NULL) - lastkbcheck > 1) {
+		if (typing_search && ++lines_tried % TYPED_SEARCH_CHECK == 0 && keyboard->wait_for_input(0)) {
+			search_interrupted = true;
+			disable_nodelay();
+			return false;
+		}
+
+		if (!typing_search && time(NULL) - lastkbcheck > 1) {
 			lastkbcheck = time(NULL);
-			if (keyboard->has_input()) {
-				auto func = func_from_key(keyboard->get_key());
-				if (func == do_cancel) {
+			if (cancel_pressed()) {
+				statusbar(_("Cancelled"));
+				return false;
+			}
+		}
+
+		/* Lines in the middle of a search get tried many at a time
+		 * first, on several threads if there are a lot of them, to skip
+		 * the ones that can't hold a match -- unless the index of
+		 * matches already tells which lines do. */
+		if (fileptr != begin && fileptr != openfile->current) {
+			filestruct *candidate;
+
+			if (filepart == NULL && usable_index(needle) != NULL) {
+				candidate = skip_to_indexed_match(fileptr, begin, &current_y_find);
+			} else {
+				candidate = parallel_search(&workers, fileptr, begin, needle, &current_y_find);
+			}
+
+			if (candidate == NULL) {
+				if (typing_search) {
+					search_interrupted = true;
+				} else {
 					statusbar(_("Cancelled"));
-					return false;
+				}
+				disable_nodelay();
+				return false;
+			}
+
+			if (candidate == fileptr && ISSET(USE_REGEXP) && batch_compiled) {
+				candidate = skip_to_regex_match(fileptr, begin, &current_y_find);
+			}
+
+			if (candidate != fileptr) {
+				fileptr = candidate;
+				rev_start = fileptr->data;
+				if (ISSET(BACKWARDS_SEARCH)) {
+					rev_start += strlen(fileptr->data);
 				}
 			}
 		}
@@ -280,17 +805,19 @@ bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x,
 
 		if (search_last_line) {
 			/* We've finished processing the file, so get out. */
-			not_found_msg(needle);
+			if (!typing_search) {
+				not_found_msg(needle);
+			}
 			disable_nodelay();
 			return false;
 		}
 
 		/* Move to the previous or next line in the file. */
 		if (ISSET(BACKWARDS_SEARCH)) {
-			fileptr = fileptr->prev;
+			fileptr = prev_line(fileptr);
 			current_y_find--;
 		} else {
-			fileptr = fileptr->next;
+			fileptr = next_line(fileptr);
 			current_y_find++;
 		}
 
@@ -303,7 +830,10 @@ bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x,
 				fileptr = openfile->fileage;
 				current_y_find = 0;
 			}
-			statusbar(_("Search Wrapped"));
+			if (!typing_search) {
+				statusbar(_("Search Wrapped"));
+			}
+			search_wrapped = true;
 		}
 
 		if (fileptr == begin) {
@@ -325,7 +855,9 @@ bool findnextstr(bool whole_word_only, const filestruct *begin, size_t begin_x,
 	        ((!ISSET(BACKWARDS_SEARCH) && current_x_find > begin_x) ||
 	         (ISSET(BACKWARDS_SEARCH) && current_x_find < begin_x))
 	   ) {
-		not_found_msg(needle);
+		if (!typing_search) {
+			not_found_msg(needle);
+		}
 		disable_nodelay();
 		return false;
 	}
@@ -352,6 +884,103 @@ void findnextstr_wrap_reset(void)
 	search_last_line = false;
 }
 
+/* Note where the cursor is as the search prompt comes up, so that the
+ * search for what is typed can start from there, and go back there. */
+void start_typed_search(void)
+{
+	typed_from = openfile->current;
+	typed_from_x = openfile->current_x;
+	typed_from_y = openfile->current_y;
+	typed_pww = openfile->placewewant;
+	typed_edittop = openfile->edittop;
+	typed_needle = "";
+	typed_match_kept = false;
+}
+
+/* Put the cursor and the edit window back the way they were when the
+ * search prompt came up. */
+static void back_to_typed_from(void)
+{
+	if (openfile->current == typed_from && openfile->current_x == typed_from_x && openfile->edittop == typed_edittop) {
+		return;
+	}
+
+	openfile->current = typed_from;
+	openfile->current_x = typed_from_x;
+	openfile->current_y = typed_from_y;
+	openfile->placewewant = typed_pww;
+	openfile->edittop = typed_edittop;
+	edit_refresh();
+}
+
+/* Search for what has been typed at the search prompt so far, from where
+ * the prompt came up.  When it isn't a regex and merely adds to what the
+ * cursor is on a match of, a match of it can't come any sooner, so go on
+ * from there.  Give up as soon as another key comes in. */
+void search_as_typed(void)
+{
+	filestruct *was_current = openfile->current;
+	size_t was_pww = openfile->placewewant;
+	bool resume = (!ISSET(USE_REGEXP) && typed_needle != "" && answer.compare(0, typed_needle.length(), typed_needle) == 0);
+	bool found;
+
+	if (!resume) {
+		back_to_typed_from();
+		typed_needle = "";
+	}
+
+	regexp_cleanup();
+
+	if (answer == "") {
+		return;
+	}
+
+	/* A regex that is still being typed may not be valid yet. */
+	if (ISSET(USE_REGEXP)) {
+		regex_t trial;
+
+		if (regcomp(&trial, answer.c_str(), REG_EXTENDED) != 0) {
+			return;
+		}
+		regfree(&trial);
+		regexp_init(answer.c_str());
+	}
+
+	typing_search = true;
+	search_interrupted = false;
+	search_at_cursor = resume;
+	search_last_line = (resume && typed_wrapped && openfile->current == typed_from);
+
+	found = findnextstr(false, typed_from, typed_from_x, answer, NULL);
+
+	typing_search = false;
+	search_at_cursor = false;
+
+	if (found) {
+		typed_wrapped = (resume && typed_wrapped) || search_wrapped;
+		typed_needle = answer;
+	} else if (!search_interrupted) {
+		back_to_typed_from();
+		typed_needle = "";
+	}
+
+	openfile->placewewant = xplustabs();
+	edit_redraw(was_current, was_pww);
+}
+
+/* Leave the search prompt.  If Enter was pressed, and the cursor is on a
+ * match of what was typed, stay there; otherwise go back. */
+void end_typed_search(bool entered)
+{
+	regexp_cleanup();
+
+	typed_match_kept = (entered && typed_needle != "" && typed_needle == answer);
+
+	if (!typed_match_kept) {
+		back_to_typed_from();
+	}
+}
+
 /* Search for a string. */
 void do_search(void)
 {
@@ -390,13 +1019,30 @@ void do_search(void)
 		search_history.add(answer);
 	}
 
-	findnextstr_wrap_reset();
-	didfind = findnextstr(false, openfile->current, openfile->current_x, answer, NULL);
+	index_matches(answer.c_str());
+
+	if (typed_match_kept) {
+		/* It was found already, while it was being typed. */
+		typed_match_kept = false;
+		didfind = true;
+		search_wrapped = typed_wrapped;
+		if (search_wrapped) {
+			statusbar(_("Search Wrapped"));
+		}
+	} else {
+		findnextstr_wrap_reset();
+		didfind = findnextstr(false, openfile->current, openfile->current_x, answer, NULL);
+	}
 
 	/* If we found something, and we're back at the exact same spot where
 	 * we started searching, then this is the only occurrence. */
 	if (fileptr == openfile->current && fileptr_x == openfile->current_x && didfind) {
 		statusbar(_("This is the only occurrence"));
+		count_wanted = false;
+	} else if (didfind) {
+		want_match_count();
+	} else {
+		count_wanted = false;
 	}
 
 	openfile->placewewant = xplustabs();
@@ -424,6 +1070,8 @@ void do_research(void)
 			return;
 		}
 
+		index_matches(last_search.c_str());
+
 		findnextstr_wrap_reset();
 		didfind = findnextstr(false, openfile->current, openfile->current_x, last_search.c_str(), NULL);
 
@@ -431,6 +1079,11 @@ void do_research(void)
 		 * where we started searching, then this is the only occurrence. */
 		if (fileptr == openfile->current && fileptr_x == openfile->current_x && didfind) {
 			statusbar(_("This is the only occurrence"));
+			count_wanted = false;
+		} else if (didfind) {
+			want_match_count();
+		} else {
+			count_wanted = false;
 		}
 	} else {
 		statusbar(_("No current search pattern"));
@@ -447,44 +1100,55 @@ int replace_regexp(char *string, bool create)
 	 * calculate the size of the replacement line (necessary because of
 	 * subexpressions \1 to \9 in the replaced text). */
 
-	const char *c = last_replace.c_str();
 	size_t search_match_count = regmatches[0].rm_eo - regmatches[0].rm_so;
 	size_t new_line_size = strlen(openfile->current->data) + 1 - search_match_count;
 
+	return new_line_size + regexp_replacement(openfile->current->data + openfile->current_x, create ? string : NULL);
+}
+
+/* Work out the replacement text for the regex match at match, filling
+ * in the subexpressions \1 to \9 from regmatches.  If string isn't
+ * NULL, write the text and a terminating null there.  Return the
+ * length of the text. */
+size_t regexp_replacement(const char *match, char *string)
+{
+	const char *c = last_replace.c_str();
+	size_t length = 0;
+
 	/* Iterate through the replacement text to handle subexpression
 	 * replacement using \1, \2, \3, etc. */
 	while (*c != '\0') {
 		int num = (*(c + 1) - '0');
 
 		if (*c != '\\' || num < 1 || num > 9 || num > search_regexp.re_nsub) {
-			if (create) {
+			if (string != NULL) {
 				*string++ = *c;
 			}
 			c++;
-			new_line_size++;
+			length++;
 		} else {
 			size_t i = regmatches[num].rm_eo - regmatches[num].rm_so;
 
 			/* Skip over the replacement expression. */
 			c += 2;
 
-			/* But add the length of the subexpression to new_size. */
-			new_line_size += i;
+			/* But add the length of the subexpression. */
+			length += i;
 
-			/* And if create is true, append the result of the
-			 * subexpression match to the new line. */
-			if (create) {
-				strncpy(string, openfile->current->data + openfile->current_x + regmatches[num].rm_so, i);
+			/* And if we're writing, append the result of the
+			 * subexpression match. */
+			if (string != NULL) {
+				strncpy(string, match + regmatches[num].rm_so, i);
 				string += i;
 			}
 		}
 	}
 
-	if (create) {
+	if (string != NULL) {
 		*string = '\0';
 	}
 
-	return new_line_size;
+	return length;
 }
 
 char *replace_line(const char *needle)
@@ -521,6 +1185,138 @@ char *replace_line(const char *needle)
 	return copy;
 }
 
+/* Replace all further matches of needle with answer in one sweep,
+ * going on from just after the replacement that was made at (current,
+ * current_x), or one character further if that replaced an empty match.
+ * The matches are the ones that repeated calls of findnextstr() would
+ * find, up to where it would wrap around onto real_current a second
+ * time, but each line is built just once with all its replacements and
+ * saved just once for the grouped undo.  Keep real_current_x in step
+ * with the changes on its line, and return the number of replacements. */
+static ssize_t replace_all_remaining(const filestruct *real_current, size_t *real_current_x, const char *needle, bool after_empty)
+{
+	filestruct *line = openfile->current;
+	size_t from = (openfile->current_x == (size_t)-1) ? 0 : move_mbright(line->data, openfile->current_x);
+	bool last_line = search_last_line;
+	ssize_t numreplaced = 0;
+	std::string copy;
+
+	if (after_empty) {
+		from = move_mbright(line->data, from);
+	}
+
+	bool after_match = !after_empty;
+	/* Whether from is where a match that wasn't empty ended. */
+
+	while (true) {
+		const char *data = line->data, *found;
+		size_t done = 0, replaced = 0;
+		/* How much of data has gone into copy, and how many matches. */
+
+		copy.clear();
+
+		while ((found = strstrwrapper(data, needle, data + from)) != NULL) {
+			size_t match_x = found - data;
+			size_t match_len = ISSET(USE_REGEXP) ? regmatches[0].rm_eo - regmatches[0].rm_so : strlen(needle);
+
+			/* An empty match right where another one ended is passed
+			 * over, as sed does. */
+			if (match_len == 0 && match_x == from && after_match) {
+				if (data[from] == '\0') {
+					break;
+				}
+				from = move_mbright(data, from);
+				after_match = false;
+				continue;
+			}
+
+			size_t new_x = copy.size() + match_x - done;
+			/* Where the match begins in the changed line. */
+
+			/* Back on the line where we started, stop short of matches
+			 * after the cursor, just as findnextstr() does. */
+			if (last_line && new_x > *real_current_x) {
+				break;
+			}
+
+			copy.append(data + done, match_x - done);
+
+			if (ISSET(USE_REGEXP)) {
+				size_t length = regexp_replacement(found, NULL);
+
+				copy.resize(new_x + length + 1);
+				regexp_replacement(found, &copy[new_x]);
+				copy.resize(new_x + length);
+			} else {
+				copy += answer;
+			}
+
+			/* Keep real_current_x in sync with the text changes. */
+			if (line == real_current && new_x <= *real_current_x) {
+				if (*real_current_x < new_x + match_len) {
+					*real_current_x = new_x + match_len;
+				}
+				*real_current_x += copy.size() - new_x - match_len;
+			}
+
+			done = match_x + match_len;
+			replaced++;
+			after_match = (match_len > 0);
+
+			/* Step over the character after an empty match, so that
+			 * it isn't matched over and over. */
+			if (match_len == 0) {
+				if (data[done] == '\0') {
+					break;
+				}
+				done = move_mbright(data, done);
+				copy.append(data + match_x, done - match_x);
+			}
+			from = done;
+		}
+
+		if (replaced > 0) {
+			copy.append(data + done);
+
+			openfile->current = line;
+			update_undo(REPLACE_ALL);
+			reset_multis(line->lineno);
+
+			openfile->totsize += mbstrlen(copy.c_str()) - mbstrlen(data);
+			free(line->data);
+			line->data = mallocstrcpy(NULL, copy.c_str());
+			forget_widths(line);
+			numreplaced += replaced;
+		}
+
+		if (last_line) {
+			break;
+		}
+
+		/* Move to the next line, wrapping around at the end. */
+		line = next_line(line);
+		if (line == NULL) {
+			line = openfile->fileage;
+		}
+		from = 0;
+		after_match = false;
+
+		if (line == real_current) {
+			last_line = true;
+		} else if (ISSET(USE_REGEXP) && batch_compiled) {
+			ssize_t ignored_y = 0;
+
+			line = skip_to_regex_match(line, real_current, &ignored_y);
+		}
+	}
+
+	if (numreplaced > 0) {
+		set_modified();
+	}
+
+	return numreplaced;
+}
+
 /* Step through each replace word and prompt user before replacing.
  * Parameters real_current and real_current_x are needed in order to
  * allow the cursor position to be updated when a word before the cursor
@@ -609,10 +1405,17 @@ ssize_t do_replace_loop(bool whole_word_only, bool *canceled, const filestruct *
 			char *copy;
 			size_t length_change;
 
-			add_undo(REPLACE);
-
+			/* All the replacements after the user says "All" go into
+			 * one undo item, which keeps each line just once. */
 			if (i == 2) {
 				replaceall = true;
+				add_undo(REPLACE_ALL);
+			}
+
+			if (replaceall) {
+				update_undo(REPLACE_ALL);
+			} else {
+				add_undo(REPLACE);
 			}
 
 			copy = replace_line(needle);
@@ -657,12 +1460,12 @@ ssize_t do_replace_loop(bool whole_word_only, bool *canceled, const filestruct *
 			openfile->totsize += mbstrlen(copy) - mbstrlen(openfile->current->data);
 			free(openfile->current->data);
 			openfile->current->data = copy;
+			forget_widths(openfile->current);
 
-			/* Reset the precalculated multiline-regex hints only when the first replacement has been made. */
-			if (numreplaced == 0) {
-				reset_multis(openfile->current, true);
-			}
 			if (!replaceall) {
+				/* Let the undo item keep just the changed part. */
+				update_undo(REPLACE);
+
 				/* If color syntaxes are available and turned on, we
 				 * need to call edit_refresh(). */
 				if (!openfile->colorstrings.empty() && !ISSET(NO_COLOR_SYNTAX)) {
@@ -674,6 +1477,13 @@ ssize_t do_replace_loop(bool whole_word_only, bool *canceled, const filestruct *
 
 			set_modified();
 			numreplaced++;
+
+			/* Going forward through the whole buffer, the remaining
+			 * matches need no checks one by one, so do them together. */
+			if (replaceall && !ISSET(BACKWARDS_SEARCH) && !whole_word_only && !old_mark_set) {
+				numreplaced += replace_all_remaining(real_current, real_current_x, needle, match_len == 0);
+				break;
+			}
 		}
 	}
 
@@ -785,9 +1595,19 @@ void do_replace(void)
 /* Go to the specified line and x position. */
 void goto_line_posx(ssize_t line, size_t pos_x)
 {
-	for (openfile->current = openfile->fileage; openfile->current != openfile->filebot && openfile->current->next != NULL && line > 1; line--) {
-		openfile->current = openfile->current->next;
-	}
+	openfile->current = line_from_number(line);
+
+	openfile->current_x = pos_x;
+	openfile->placewewant = xplustabs();
+
+	edit_refresh_needed = true;
+}
+
+/* Go to position pos_x of the given line, without looking it up by its
+ * number. */
+void goto_fileptr_posx(filestruct *line, size_t pos_x)
+{
+	openfile->current = line;
 
 	openfile->current_x = pos_x;
 	openfile->placewewant = xplustabs();
@@ -864,11 +1684,9 @@ void do_gotolinecolumn(ssize_t line, ssize_t column, bool use_answer, bool inter
 		}
 	}
 
-	for (openfile->current = openfile->fileage; openfile->current != openfile->filebot && line > 1; line--) {
-		openfile->current = openfile->current->next;
-	}
+	openfile->current = line_from_number(line);
 
-	openfile->current_x = actual_x(openfile->current->data, column - 1);
+	openfile->current_x = line_actual_x(openfile->current, column - 1);
 	openfile->placewewant = column - 1;
 
 	/* Put the top line of the edit window in range of the current line.
@@ -904,72 +1722,12 @@ void do_gotopos(ssize_t pos_line, size_t pos_x, ssize_t pos_y, size_t pos_pww)
 	update_line(openfile->current, pos_x);
 }
 
-/* Search for a match to one of the two characters in bracket_set.  If
- * reverse is true, search backwards for the leftmost bracket.
- * Otherwise, search forwards for the rightmost bracket.  Return true if
- * we found a match, and false otherwise. */
-bool find_bracket_match(bool reverse, const char *bracket_set)
-{
-	filestruct *fileptr = openfile->current;
-	const char *rev_start = NULL, *found = NULL;
-	ssize_t current_y_find = openfile->current_y;
-
-	assert(mbstrlen(bracket_set) == 2);
-
-	/* rev_start might end up 1 character before the start or after the
-	 * end of the line.  This won't be a problem because we'll skip over
-	 * it below in that case, and rev_start will be properly set when
-	 * the search continues on the previous or next line. */
-	rev_start = reverse ? fileptr->data + (openfile->current_x - 1) : fileptr->data + (openfile->current_x + 1);
-
-	/* Look for either of the two characters in bracket_set.  rev_start
-	 * can be 1 character before the start or after the end of the line.
-	 * In either case, just act as though no match is found. */
-	while (true) {
-		found = ((rev_start > fileptr->data && *(rev_start - 1) ==
-		          '\0') || rev_start < fileptr->data) ? NULL : (reverse ?
-		                  mbrevstrpbrk(fileptr->data, bracket_set, rev_start) :
-		                  mbstrpbrk(rev_start, bracket_set));
-
-		if (found != NULL) {
-			/* We've found a potential match. */
-			break;
-		}
-
-		if (reverse) {
-			fileptr = fileptr->prev;
-			current_y_find--;
-		} else {
-			fileptr = fileptr->next;
-			current_y_find++;
-		}
-
-		if (fileptr == NULL) {
-			/* We've reached the start or end of the buffer, so get out. */
-			return false;
-		}
-
-		rev_start = fileptr->data;
-		if (reverse) {
-			rev_start += strlen(fileptr->data);
-		}
-	}
-
-	/* We've definitely found something. */
-	openfile->current = fileptr;
-	openfile->current_x = found - fileptr->data;
-	openfile->placewewant = xplustabs();
-	openfile->current_y = current_y_find;
-
-	return true;
-}
-
 /* Search for a match to the bracket at the current cursor position, if
  * there is one. */
 void do_find_bracket(void)
 {
-	filestruct *current_save;
-	size_t current_x_save, pww_save;
+	filestruct *current_save, *line;
+	size_t current_x_save, pww_save, x;
 	const char *ch;
 	/* The location in matchbrackets of the bracket at the current
 	 * cursor position. */
@@ -980,8 +1738,6 @@ void do_find_bracket(void)
 	 * the bracket at the current cursor position. */
 	int wanted_ch_len;
 	/* The length of wanted_ch in bytes. */
-	char *bracket_set;
-	/* The pair of characters in ch and wanted_ch. */
 	size_t i;
 	/* Generic loop variable. */
 	size_t matchhalf;
@@ -990,12 +1746,8 @@ void do_find_bracket(void)
 	size_t mbmatchhalf;
 	/* The number of multibyte characters in one half of
 	 * matchbrackets. */
-	size_t count = 1;
-	/* The initial bracket count. */
 	bool reverse;
 	/* The direction we search. */
-	char *found_ch;
-	/* The character we find. */
 
 	assert(mbstrlen(matchbrackets) % 2 == 0);
 
@@ -1044,41 +1796,32 @@ void do_find_bracket(void)
 	ch_len = parse_mbchar(ch, NULL, NULL);
 	wanted_ch_len = parse_mbchar(wanted_ch, NULL, NULL);
 
-	/* Fill bracket_set in with the values of ch and wanted_ch. */
-	bracket_set = charalloc((mb_cur_max() * 2) + 1);
-	strncpy(bracket_set, ch, ch_len);
-	strncpy(bracket_set + ch_len, wanted_ch, wanted_ch_len);
-	null_at(&bracket_set, ch_len + wanted_ch_len);
-
-	found_ch = charalloc(mb_cur_max() + 1);
+	std::string bracket(ch, ch_len), wanted(wanted_ch, wanted_ch_len);
+	const std::string& opening = reverse ? wanted : bracket;
+	const std::string& closing = reverse ? bracket : wanted;
 
-	while (true) {
-		if (find_bracket_match(reverse, bracket_set)) {
-			/* If we found an identical bracket, increment count.  If we
-			 * found a complementary bracket, decrement it. */
-			parse_mbchar(openfile->current->data + openfile->current_x, found_ch, NULL);
-			count += (strncmp(found_ch, ch, ch_len) == 0) ? 1 : -1;
-
-			/* If count is zero, we've found a matching bracket.  Update
-			 * the screen and get out. */
-			if (count == 0) {
-				edit_redraw(current_save, pww_save);
-				break;
-			}
-		} else {
-			/* We didn't find either an opening or closing bracket.
-			 * Indicate this, restore where we were, and get out. */
-			statusbar(_("No matching bracket"));
-			openfile->current = current_save;
-			openfile->current_x = current_x_save;
-			openfile->placewewant = pww_save;
-			break;
-		}
+	/* Counting the brackets is left to the index of them in the buffer,
+	 * which can pass over whole stretches of lines at once.  A bracket
+	 * that is its own complement never has a match. */
+	if (openfile->brackets == NULL || !openfile->brackets->is_for(opening.c_str(), closing.c_str())) {
+		delete openfile->brackets;
+		openfile->brackets = new BracketIndex(opening.c_str(), closing.c_str());
 	}
 
-	/* Clean up. */
-	free(bracket_set);
-	free(found_ch);
+	line = current_save;
+	x = current_x_save;
+
+	if (bracket != wanted && openfile->brackets->find_match(&line, &x, reverse)) {
+		/* We've found the matching bracket.  Update the screen. */
+		openfile->current_y += line->lineno - current_save->lineno;
+		openfile->current = line;
+		openfile->current_x = x;
+		openfile->placewewant = xplustabs();
+		edit_redraw(current_save, pww_save);
+	} else {
+		/* We didn't find it.  Indicate this, and stay where we are. */
+		statusbar(_("No matching bracket"));
+	}
 }
 
 /* More placeholders */
@@ -121,16 +121,9 @@ class Syntax {
 };
 typedef std::unordered_map<std::string, Syntax *> SyntaxMap;
 
-/* Flags that indicate how a multiline regex applies to a line. */
-#define CNONE 		(1<<1)
-/* Yay, regex doesn't apply to this line at all! */
-#define CBEGINBEFORE 	(1<<2)
-/* regex starts on an earlier line, ends on this one */
-#define CENDAFTER 	(1<<3)
-/* regex sraers on this line and ends on a later one */
-#define CWHOLELINE 	(1<<4)
-/* whole line engulfed by the regex  start < me, end > me */
-#define CSTARTENDHERE 	(1<<5)
-/* regex starts and ends within this line */
+/* Flags that tell whether a multiline regex is open at the start and at
+ * the end of a line. */
+#define MULTI_OPEN_BEFORE	(1<<0)
+#define MULTI_OPEN_AFTER	(1<<1)
 
 extern SyntaxMap syntaxes;
@@ -88,6 +88,7 @@ void do_deletion(UndoType action)
 		charmove(&openfile->current->data[openfile->current_x], &openfile->current->data[openfile->current_x + char_buf_len], line_len - char_buf_len + 1);
 
 		null_at(&openfile->current->data, openfile->current_x + line_len - char_buf_len);
+		forget_widths(openfile->current);
 		if (openfile->mark_set && openfile->mark_begin == openfile->current && openfile->current_x < openfile->mark_begin_x) {
 			openfile->mark_begin_x -= char_buf_len;
 		}
@@ -101,6 +102,7 @@ void do_deletion(UndoType action)
 
 		openfile->current->data = charealloc(openfile->current->data, strlen(openfile->current->data) + strlen(foo->data) + 1);
 		strcat(openfile->current->data, foo->data);
+		forget_widths(openfile->current);
 		if (openfile->mark_set && openfile->mark_begin == openfile->current->next) {
 			openfile->mark_begin = openfile->current;
 			openfile->mark_begin_x += openfile->current_x;
@@ -262,6 +264,7 @@ void do_indent(ssize_t cols)
 			f->data = charealloc(f->data, line_len + line_indent_len + 1);
 			charmove(&f->data[indent_len + line_indent_len], &f->data[indent_len], line_len - indent_len + 1);
 			strncpy(f->data + indent_len, line_indent, line_indent_len);
+			forget_widths(f);
 			openfile->totsize += line_indent_len;
 
 			/* Keep track of the change in the current line. */
@@ -295,6 +298,7 @@ void do_indent(ssize_t cols)
 				 * non-whitespace text of this line, remove it. */
 				charmove(&f->data[indent_new], &f->data[indent_len], line_len - indent_shift - indent_new + 1);
 				null_at(&f->data, line_len - indent_shift + 1);
+				forget_widths(f);
 				openfile->totsize -= indent_shift;
 
 				/* Keep track of the change in the current line. */
@@ -406,12 +410,76 @@ void undo_paste(undo *u)
 	cutbottom = oldcutbottom;
 }
 
+/* Swap the text of each line saved by a replace-all with what the line
+ * holds now, last saved first when undoing and first saved first when
+ * redoing, so that a line saved twice comes out right either way. */
+void swap_replaced_lines(undo *u, bool undoing)
+{
+	for (filestruct *t = undoing ? u->cutbottom : u->cutbuffer; t != NULL; t = undoing ? t->prev : t->next) {
+		filestruct *f = fsfromline(t->lineno);
+		char *data = t->data;
+
+		if (f == NULL) {
+			statusbar(_("Internal error: can't match line %d.  Please save your work."), t->lineno);
+			return;
+		}
+
+		reset_multis(t->lineno);
+		openfile->totsize += mbstrlen(data) - mbstrlen(f->data);
+		t->data = f->data;
+		f->data = data;
+		forget_widths(t);
+		forget_widths(f);
+	}
+}
+
+/* Swap the part of line f that a replacement changed with the text that
+ * the undo item u holds in its place. */
+void swap_replaced_text(undo *u, filestruct *f)
+{
+	size_t len = strlen(f->data), middle = len - u->same_front - u->same_back;
+	char *data = charalloc(len - middle + strlen(u->strdata) + 1);
+	char *was = mallocstrncpy(NULL, &f->data[u->same_front], middle + 1);
+
+	was[middle] = '\0';
+	strncpy(data, f->data, u->same_front);
+	strcpy(&data[u->same_front], u->strdata);
+	strcat(data, &f->data[len - u->same_back]);
+
+	free(f->data);
+	f->data = data;
+	forget_widths(f);
+	free(u->strdata);
+	u->strdata = was;
+}
+
+/* Put the string s into line f at index x, moving the rest of the line up
+ * in place rather than building the line anew. */
+void insert_into_line(filestruct *f, size_t x, const char *s)
+{
+	size_t s_len = strlen(s), line_len = strlen(f->data);
+
+	f->data = charealloc(f->data, line_len + s_len + 1);
+	charmove(&f->data[x + s_len], &f->data[x], line_len - x + 1);
+	memcpy(&f->data[x], s, s_len);
+	forget_widths(f);
+}
+
+/* Take len bytes out of line f at index x, in place. */
+void remove_from_line(filestruct *f, size_t x, size_t len)
+{
+	size_t line_len = strlen(f->data);
+
+	charmove(&f->data[x], &f->data[x + len], line_len - x - len + 1);
+	null_at(&f->data, line_len - len);
+	forget_widths(f);
+}
+
 /* Undo the last thing(s) we did */
 void do_undo(void)
 {
 	undo *u = openfile->current_undo;
 	filestruct *t = nullptr;
-	size_t len = 0;
 	char *data;
 	const char *undidmsg = NULL;
 	filestruct *oldcutbuffer = cutbuffer, *oldcutbottom = cutbottom;
@@ -428,32 +496,27 @@ void do_undo(void)
 	}
 
 	DEBUG_LOG("data we're about to undo = \"" << f->data << '"');
+
+	/* The text changes from the first line that the action touched on. */
+	reset_multis(u->lineno);
+	reset_multis(u->mark_begin_lineno);
 	DEBUG_LOG("Undo running for type " << u->type);
 
 	openfile->current_x = u->begin;
 	switch(u->type) {
 	case ADD:
 		undidmsg = _("text add");
-		len = strlen(f->data) - strlen(u->strdata) + 1;
-		data = charalloc(len);
-		strncpy(data, f->data, u->begin);
-		strcpy(&data[u->begin], &f->data[u->begin + strlen(u->strdata)]);
-		free(f->data);
-		f->data = data;
-		goto_line_posx(u->lineno, u->begin);
+		remove_from_line(f, u->begin, strlen(u->strdata));
+		if (openfile->mark_set && openfile->mark_begin == f && openfile->mark_begin_x > u->begin) {
+			openfile->mark_begin_x = (openfile->mark_begin_x > u->begin + strlen(u->strdata)) ? openfile->mark_begin_x - strlen(u->strdata) : u->begin;
+		}
+		goto_fileptr_posx(f, u->begin);
 		break;
 	case BACK:
 	case DEL:
 		undidmsg = _("text delete");
-		len = strlen(f->data) + strlen(u->strdata) + 1;
-		data = charalloc(len);
-
-		strncpy(data, f->data, u->begin);
-		strcpy(&data[u->begin], u->strdata);
-		strcpy(&data[u->begin + strlen(u->strdata)], &f->data[u->begin]);
-		free(f->data);
-		f->data = data;
-		goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
+		insert_into_line(f, u->begin, u->strdata);
+		goto_fileptr_posx(f, u->mark_begin_x);
 		break;
 	case SPLIT_END:
 		goto_line_posx(u->lineno, u->begin);
@@ -479,6 +542,7 @@ void do_undo(void)
 			data[u->mark_begin_x] = '\0';
 			free(f->data);
 			f->data = data;
+			forget_widths(f);
 			splice_node(f, t, f->next);
 			if (f == openfile->filebot) {
 				openfile->filebot = t;
@@ -501,11 +565,17 @@ void do_undo(void)
 		undidmsg = _("line break");
 		if (f->next) {
 			filestruct *foo = f->next;
+			size_t f_len = strlen(f->data);
 			f->data = (char *) nrealloc(f->data, strlen(f->data) + strlen(&f->next->data[u->mark_begin_x]) + 1);
 			strcat(f->data, &f->next->data[u->mark_begin_x]);
+			forget_widths(f);
 			if (foo == openfile->filebot) {
 				openfile->filebot = f;
 			}
+			if (openfile->mark_set && openfile->mark_begin == foo) {
+				openfile->mark_begin = f;
+				openfile->mark_begin_x = f_len + (openfile->mark_begin_x > u->mark_begin_x ? openfile->mark_begin_x - u->mark_begin_x : 0);
+			}
 			unlink_node(foo);
 			delete_node(foo);
 		}
@@ -534,10 +604,13 @@ void do_undo(void)
 		break;
 	case REPLACE:
 		undidmsg = _("text replace");
+		goto_fileptr_posx(f, u->begin);
+		swap_replaced_text(u, f);
+		break;
+	case REPLACE_ALL:
+		undidmsg = _("text replace");
+		swap_replaced_lines(u, true);
 		goto_line_posx(u->lineno, u->begin);
-		data = u->strdata;
-		u->strdata = f->data;
-		f->data = data;
 		break;
 
 	default:
@@ -548,18 +621,22 @@ void do_undo(void)
 	if (undidmsg) {
 		statusbar(_("Undid action (%s)"), undidmsg);
 	}
-	renumber(f);
+	/* Only the actions that added or removed lines have changed the
+	 * numbering, and renumbering runs through the rest of the file. */
+	if (u->type != ADD && u->type != BACK && u->type != DEL && u->type != REPLACE && u->type != REPLACE_ALL) {
+		renumber(f);
+	}
 	openfile->current_undo = openfile->current_undo->next;
 	openfile->last_action = OTHER;
 	openfile->placewewant = xplustabs();
 	set_modified();
+	recount_undo(u);
 }
 
 void do_redo(void)
 {
 	undo *u = openfile->undotop;
 	size_t len = 0;
-	char *data;
 	const char *redidmsg = NULL;
 
 	for (; u != NULL && u->next != openfile->current_undo; u = u->next) {
@@ -580,31 +657,23 @@ void do_redo(void)
 		return;
 	}
 	DEBUG_LOG("data we're about to redo = \"" << f->data << '"');
+
+	/* The text changes from the first line that the action touched on. */
+	reset_multis(u->lineno);
+	reset_multis(u->mark_begin_lineno);
 	DEBUG_LOG("Redo running for type " << u->type);
 
 	switch(u->type) {
 	case ADD:
 		redidmsg = _("text add");
-		len = strlen(f->data) + strlen(u->strdata) + 1;
-		data = charalloc(len);
-		strncpy(data, f->data, u->begin);
-		strcpy(&data[u->begin], u->strdata);
-		strcpy(&data[u->begin + strlen(u->strdata)], &f->data[u->begin]);
-		free(f->data);
-		f->data = data;
-		goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
+		insert_into_line(f, u->begin, u->strdata);
+		goto_fileptr_posx(f, u->mark_begin_x);
 		break;
 	case BACK:
 	case DEL:
 		redidmsg = _("text delete");
-		len = strlen(f->data) + strlen(u->strdata) + 1;
-		data = charalloc(len);
-		strncpy(data, f->data, u->begin);
-		strcpy(&data[u->begin], &f->data[u->begin + strlen(u->strdata)]);
-		free(f->data);
-		f->data = data;
-		openfile->current_x = u->begin;
-		goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
+		remove_from_line(f, u->begin, strlen(u->strdata));
+		goto_fileptr_posx(f, u->mark_begin_x);
 		break;
 	case ENTER:
 		redidmsg = _("line break");
@@ -627,8 +696,13 @@ void do_redo(void)
 	case JOIN:
 		redidmsg = _("line join");
 		len = strlen(f->data) + strlen(u->strdata) + 1;
+		if (openfile->mark_set && openfile->mark_begin == f->next) {
+			openfile->mark_begin = f;
+			openfile->mark_begin_x += strlen(f->data);
+		}
 		f->data = charealloc(f->data, len);
 		strcat(f->data, u->strdata);
+		forget_widths(f);
 		if (f->next != NULL) {
 			filestruct *tmp = f->next;
 			if (tmp == openfile->filebot) {
@@ -651,9 +725,12 @@ void do_redo(void)
 		break;
 	case REPLACE:
 		redidmsg = _("text replace");
-		data = u->strdata;
-		u->strdata = f->data;
-		f->data = data;
+		swap_replaced_text(u, f);
+		goto_fileptr_posx(f, u->begin);
+		break;
+	case REPLACE_ALL:
+		redidmsg = _("text replace");
+		swap_replaced_lines(u, false);
 		goto_line_posx(u->lineno, u->begin);
 		break;
 	case INSERT:
@@ -677,6 +754,24 @@ void do_redo(void)
 	openfile->last_action = OTHER;
 	openfile->placewewant = xplustabs();
 	set_modified();
+	recount_undo(u);
+}
+
+/* Say how many actions the undo history of the current buffer holds, and
+ * how much memory they take up. */
+void do_undo_usage(void)
+{
+	size_t actions = 0;
+
+	for (const undo *u = openfile->undotop; u != NULL; u = u->next) {
+		actions++;
+	}
+
+	if (undo_limit > 0) {
+		statusbar(_("Undo history: %lu actions in %lu KB (limit %ld KB)"), (unsigned long)actions, (unsigned long)((openfile->undo_size + 1023) / 1024), (long)undo_limit);
+	} else {
+		statusbar(_("Undo history: %lu actions in %lu KB"), (unsigned long)actions, (unsigned long)((openfile->undo_size + 1023) / 1024));
+	}
 }
 
 /* Someone hits Enter *gasp!* */
@@ -711,6 +806,7 @@ void do_enter(bool undoing)
 	}
 
 	null_at(&openfile->current->data, openfile->current_x);
+	forget_widths(openfile->current);
 
 	if (openfile->mark_set && openfile->current == openfile->mark_begin && openfile->current_x < openfile->mark_begin_x) {
 		openfile->mark_begin = newnode;
@@ -924,12 +1020,118 @@ int execute_command_silently(const std::string& command)
 	return WEXITSTATUS(status);
 }
 
+/* Return how many bytes the undo item u takes up. */
+size_t undo_item_size(const undo *u)
+{
+	size_t size = sizeof(undo);
+
+	if (u->strdata != NULL) {
+		size += strlen(u->strdata) + 1;
+	}
+	for (const filestruct *t = u->cutbuffer; t != NULL; t = t->next) {
+		size += sizeof(filestruct) + strlen(t->data) + 1;
+	}
+
+	return size;
+}
+
+/* Count the undo item u anew after it has changed, and the total of the
+ * current buffer with it. */
+void recount_undo(undo *u)
+{
+	size_t size = undo_item_size(u);
+
+	openfile->undo_size = openfile->undo_size - u->size + size;
+	u->size = size;
+}
+
+/* Free the undo item u and whatever it holds. */
+void free_undo(undo *u)
+{
+	free(u->strdata);
+	if (u->cutbuffer) {
+		free_filestruct(u->cutbuffer);
+	}
+	free(u);
+}
+
+/* If the undo history of the current buffer takes up more than the limit,
+ * forget the oldest actions until it's down to three quarters of it, so
+ * that this doesn't have to be done again for a while.  The newest action
+ * is always kept, and a wrap's actions from SPLIT_BEGIN to SPLIT_END are
+ * kept or forgotten together. */
+void trim_undo_history(void)
+{
+	size_t limit = (size_t)undo_limit * 1024, goal = limit / 4 * 3, kept = 0;
+	undo *last = NULL, *u = openfile->undotop;
+	int splits = 0;
+	/* How many wraps we're in the middle of, going down the pile. */
+
+	if (undo_limit == 0 || openfile->undo_size <= limit) {
+		return;
+	}
+
+	while (u != NULL) {
+		if (last != NULL && splits == 0 && kept + u->size > goal) {
+			/* A SPLIT_BEGIN that comes below before any SPLIT_END belongs
+			 * to a wrap that is still being done, so keep it as well. */
+			undo *split = u;
+
+			while (split != NULL && split->type != SPLIT_BEGIN && split->type != SPLIT_END) {
+				split = split->next;
+			}
+			if (split == NULL || split->type == SPLIT_END) {
+				break;
+			}
+			for (; u != split->next; u = u->next) {
+				kept += u->size;
+				last = u;
+			}
+			continue;
+		}
+
+		if (u->type == SPLIT_END) {
+			splits++;
+		} else if (u->type == SPLIT_BEGIN && splits > 0) {
+			splits--;
+		}
+		kept += u->size;
+		last = u;
+		u = u->next;
+	}
+
+	if (u == NULL) {
+		return;
+	}
+
+	DEBUG_LOG("trim_undo_history(): keeping " << kept << " of " << openfile->undo_size << " bytes");
+
+	last->next = NULL;
+	while (u != NULL) {
+		undo *gone = u;
+
+		u = u->next;
+		if (gone == openfile->current_undo) {
+			/* Only actions to redo are left. */
+			openfile->current_undo = NULL;
+		}
+		openfile->undo_size -= gone->size;
+		free_undo(gone);
+	}
+}
+
 /* Add a new undo struct to the top of the current pile */
 void add_undo(UndoType action)
 {
 	std::list<OpenFile>::iterator fs = openfile;
 	undo *u = fs->current_undo; // The thing we did previously.
 
+	/* The text is about to change from here on. */
+	reset_multis(fs->current->lineno);
+	if (fs->mark_set) {
+		reset_multis(fs->mark_begin->lineno);
+	}
+
 	/* When doing contiguous adds or contiguous cuts -- which means: with
 	 * no cursor movement in between -- don't add a new undo item. */
 	if (u && u->mark_begin_lineno == fs->current->lineno && ((action == ADD && u->type == ADD && u->mark_begin_x == fs->current_x) || (action == CUT && u->type == CUT && !u->mark_set && keeping_cutbuffer()))) {
@@ -945,11 +1147,8 @@ void add_undo(UndoType action)
 	while (fs->undotop != NULL && fs->undotop != fs->current_undo) {
 		undo *u2 = fs->undotop;
 		fs->undotop = fs->undotop->next;
-		free(u2->strdata);
-		if (u2->cutbuffer) {
-			free_filestruct(u2->cutbuffer);
-		}
-		free(u2);
+		fs->undo_size -= u2->size;
+		free_undo(u2);
 	}
 
 	/* Allocate and initialize a new undo type */
@@ -973,6 +1172,9 @@ void add_undo(UndoType action)
 	u->mark_begin_lineno = fs->current->lineno;
 	u->mark_begin_x = fs->current_x;
 	u->xflags = 0;
+	u->same_front = 0;
+	u->same_back = 0;
+	u->size = 0;
 
 	switch (u->type) {
 		/* We need to start copying data into the undo buffer or we wont be able
@@ -1017,6 +1219,10 @@ void add_undo(UndoType action)
 	case REPLACE:
 		u->strdata = mallocstrcpy(NULL, fs->current->data);
 		break;
+	case REPLACE_ALL:
+		/* The lines are saved one by one in update_undo(), as they are
+		 * about to be changed. */
+		break;
 	case CUT_EOF:
 		cutbuffer_reset();
 		break;
@@ -1056,6 +1262,9 @@ void add_undo(UndoType action)
 	DEBUG_LOG("fs->current->data = \"" << fs->current->data << "\", current_x = " << fs->current_x << ", u->begin = " << u->begin << ", type = " << action);
 	DEBUG_LOG("left add_undo...");
 	fs->last_action = action;
+
+	recount_undo(u);
+	trim_undo_history();
 }
 
 /* Update an undo item, or determine whether a new one
@@ -1075,7 +1284,7 @@ void update_undo(UndoType action)
 
 	/* Change to an add if we're not using the same undo struct
 	   that we should be using */
-	if (action != fs->last_action || (action != ENTER && action != CUT && action != INSERT && openfile->current->lineno != fs->current_undo->lineno)) {
+	if (action != fs->last_action || (action != ENTER && action != CUT && action != INSERT && action != REPLACE_ALL && openfile->current->lineno != fs->current_undo->lineno)) {
 		add_undo(action);
 		return;
 	}
@@ -1086,10 +1295,12 @@ void update_undo(UndoType action)
 	switch (u->type) {
 	case ADD:
 		DEBUG_LOG("fs->current->data = \"" << fs->current->data << "\", current_x = " << fs->current_x << ", u->begin = " << u->begin);
+		/* Save whatever was added between the end of the last addition
+		 * and the cursor, which can be more than one character. */
 		{
-			char *char_buf = charalloc(mb_cur_max());
-			size_t char_buf_len = parse_mbchar(&fs->current->data[u->mark_begin_x], char_buf, NULL);
-			u->strdata = addstrings(u->strdata, u->strdata ? strlen(u->strdata) : 0, char_buf, char_buf_len);
+			size_t added_len = fs->current_x - u->mark_begin_x;
+			char *added = mallocstrncpy(NULL, &fs->current->data[u->mark_begin_x], added_len);
+			u->strdata = addstrings(u->strdata, u->strdata ? strlen(u->strdata) : 0, added, added_len);
 		}
 		DEBUG_LOG("current undo data now \"" << u->strdata << '"');
 		u->mark_begin_lineno = fs->current->lineno;
@@ -1156,10 +1367,50 @@ void update_undo(UndoType action)
 		}
 		break;
 	case REPLACE:
+		/* Keep only what the replacement changed in the line, the first
+		 * time round, as the rest can be found in the line itself. */
+		if (u->strdata != NULL && u->same_front == 0 && u->same_back == 0) {
+			const char *now = fs->current->data;
+			size_t old_len = strlen(u->strdata), new_len = strlen(now), front = 0, back = 0;
+
+			while (front < old_len && front < new_len && u->strdata[front] == now[front]) {
+				front++;
+			}
+			while (back < old_len - front && back < new_len - front && u->strdata[old_len - back - 1] == now[new_len - back - 1]) {
+				back++;
+			}
+
+			memmove(u->strdata, &u->strdata[front], old_len - front - back);
+			u->strdata[old_len - front - back] = '\0';
+			u->strdata = charealloc(u->strdata, old_len - front - back + 1);
+			u->same_front = front;
+			u->same_back = back;
+		}
+		break;
 	case PASTE:
 		u->begin = fs->current_x;
 		u->lineno = openfile->current->lineno;
 		break;
+	case REPLACE_ALL:
+		/* Keep a copy of the current line as it was before any of the
+		 * replacements, unless we have it already. */
+		if (u->cutbottom == NULL || u->cutbottom->lineno != fs->current->lineno) {
+			filestruct *saved = make_new_node(u->cutbottom);
+
+			saved->data = mallocstrcpy(NULL, fs->current->data);
+			saved->lineno = fs->current->lineno;
+			if (u->cutbottom == NULL) {
+				u->cutbuffer = saved;
+			} else {
+				u->cutbottom->next = saved;
+			}
+			u->cutbottom = saved;
+
+			/* Count just the new line, rather than all of them again. */
+			u->size += sizeof(filestruct) + strlen(saved->data) + 1;
+			fs->undo_size += sizeof(filestruct) + strlen(saved->data) + 1;
+		}
+		break;
 	case INSERT:
 		u->mark_begin_lineno = openfile->current->lineno;
 		break;
@@ -1174,6 +1425,11 @@ void update_undo(UndoType action)
 		break;
 	}
 
+	if (u->type != REPLACE_ALL) {
+		recount_undo(u);
+	}
+	trim_undo_history();
+
 	DEBUG_LOG("Done in udpate_undo (type was " << action << ')');
 }
 
@@ -1285,6 +1541,7 @@ bool do_wrap(filestruct *line)
 			line->data = charealloc(line->data, line_len + 1);
 			line->data[line_len - 1] = ' ';
 			line->data[line_len] = '\0';
+			forget_widths(line);
 			after_break = line->data + wrap_loc;
 			after_break_len++;
 			openfile->totsize++;
@@ -2404,56 +2661,40 @@ void do_wordlinechar_count(void)
 {
 	size_t words = 0, chars = 0;
 	ssize_t nlines = 0;
-	size_t current_x_save = openfile->current_x;
-	size_t pww_save = openfile->placewewant;
-	filestruct *current_save = openfile->current;
 	bool old_mark_set = openfile->mark_set;
 	filestruct *top, *bot;
 	size_t top_x, bot_x;
 
+	/* Get the total word, line, and character counts, as "wc -w",
+	 * "wc -l" and "wc -c" do, but get the latter in multibyte
+	 * characters. */
 	if (old_mark_set) {
 		/* If the mark is on, partition the filestruct so that it
-		 * contains only the marked text, and turn the mark off. */
+		 * contains only the marked text, and count that. */
 		mark_order((const filestruct **)&top, &top_x, (const filestruct **)&bot, &bot_x, NULL);
 		filepart = partition_filestruct(top, top_x, bot, bot_x);
-		openfile->mark_set = false;
-	}
 
-	/* Start at the top of the file. */
-	openfile->current = openfile->fileage;
-	openfile->current_x = 0;
-	openfile->placewewant = 0;
-
-	/* Keep moving to the next word (counting punctuation characters as
-	 * part of a word, as "wc -w" does), without updating the screen,
-	 * until we reach the end of the file, incrementing the total word
-	 * count whenever we're on a word just before moving. */
-	while (openfile->current != openfile->filebot || openfile->current->data[openfile->current_x] != '\0') {
-		if (do_next_word(true, false)) {
-			words++;
-		}
-	}
-
-	/* Get the total line and character counts, as "wc -l"  and "wc -c"
-	 * do, but get the latter in multibyte characters. */
-	if (old_mark_set) {
+		words = count_words(openfile->fileage, openfile->filebot);
 		nlines = openfile->filebot->lineno - openfile->fileage->lineno + 1;
 		chars = get_totsize(openfile->fileage, openfile->filebot);
 
 		/* Unpartition the filestruct so that it contains all the text
-		 * again, and turn the mark back on. */
+		 * again. */
 		unpartition_filestruct(&filepart);
-		openfile->mark_set = true;
 	} else {
+		/* The line and character counts are kept up to date as the
+		 * file changes; the word count is redone only when the file
+		 * has changed since the last time. */
+		if (!openfile->wordcount_valid) {
+			openfile->wordcount = count_words(openfile->fileage, openfile->filebot);
+			openfile->wordcount_valid = true;
+		}
+
+		words = openfile->wordcount;
 		nlines = openfile->filebot->lineno;
 		chars = openfile->totsize;
 	}
 
-	/* Restore where we were. */
-	openfile->current = current_save;
-	openfile->current_x = current_x_save;
-	openfile->placewewant = pww_save;
-
 	/* Display the total word, line, and character counts on the statusbar. */
 	statusbar(_("%sWords: %lu  Lines: %ld  Chars: %lu"), old_mark_set ? _("In Selection:  ") : "", (unsigned long)words, (long)nlines, (unsigned long)chars);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <sys/types.h>
@@ -25,7 +26,7 @@ typedef enum {
 } UpdateType;
 
 typedef enum {
-	ADD, DEL, BACK, REPLACE, SPLIT_BEGIN, SPLIT_END, JOIN, CUT, CUT_EOF, PASTE, ENTER, INSERT, OTHER
+	ADD, DEL, BACK, REPLACE, REPLACE_ALL, SPLIT_BEGIN, SPLIT_END, JOIN, CUT, CUT_EOF, PASTE, ENTER, INSERT, OTHER
 } UndoType;
 
 typedef enum {
@@ -37,17 +38,106 @@ typedef enum {
 } YesNoPromptResult;
 
 /* Structure types. */
+typedef struct widthcache {
+	const char *data;
+	/* The text of the line when the cache was filled in, or NULL if
+	 * the line has been changed since. */
+	size_t len;
+	/* Its length in bytes. */
+	ssize_t tabsize;
+	/* The value of tabsize at the time. */
+	size_t width;
+	/* The width of the whole line in columns. */
+	std::vector<std::pair<size_t, size_t> > marks;
+	/* The index and column of the first character boundary at or after
+	 * every WIDTH_INDEX_STRIDE bytes of the line. */
+} widthcache;
+
+typedef struct colorspans {
+	size_t scanned;
+	/* How far into the line the regex has been matched so far. */
+	std::vector<std::pair<size_t, size_t> > spans;
+	/* Where each of the matches found so far starts and ends. */
+} colorspans;
+
+typedef struct linecolors {
+	size_t len;
+	/* The length of the line when it was highlighted. */
+	size_t hash;
+	/* A hash of its text at the time. */
+	size_t changes;
+	/* The value of text_changes when the text was last seen to match. */
+	std::vector<unsigned char> state;
+	/* For each color, whether its multi-line regex is open at the start
+	 * and at the end of the line. */
+	std::vector<colorspans> colors;
+	/* For each color, the stretches of the line that it paints, once the
+	 * line has been displayed. */
+} linecolors;
+
+typedef struct linechunk {
+	struct filestruct *head;
+	/* The first line of this stretch of lines, or NULL if it has been
+	 * deleted. */
+	ssize_t base;
+	/* The number of that line. */
+	size_t count;
+	/* How many lines the stretch has. */
+	size_t slot;
+	/* Where the stretch is in its buffer's list of them. */
+} linechunk;
+
+typedef struct linenumber {
+	linechunk *chunk = nullptr;
+	/* The stretch of lines of the current buffer that the line is in,
+	 * if any. */
+	ssize_t offset = 0;
+	/* How far the line is from the start of that stretch, or, if it
+	 * isn't in one, the number of the line itself. */
+
+	linenumber() = default;
+	linenumber(const linenumber& other) : offset(other) {}
+
+	/* Giving a line a number, or the number of another line, takes it
+	 * out of its stretch; if it was the first line of the stretch, the
+	 * stretch is left without one until it is renumbered. */
+	linenumber& operator=(ssize_t number) {
+		if (chunk != nullptr && offset == 0) {
+			chunk->head = nullptr;
+		}
+		chunk = nullptr;
+		offset = number;
+		return *this;
+	}
+	linenumber& operator=(const linenumber& other) {
+		return *this = (ssize_t)other;
+	}
+
+	operator ssize_t() const {
+		return (chunk != nullptr) ? chunk->base + offset : offset;
+	}
+} linenumber;
+
 typedef struct filestruct {
 	char *data;
 	/* The text of this line. */
-	ssize_t lineno;
-	/* The number of this line. */
+	linenumber lineno;
+	/* The number of this line.  In the current buffer, it's kept
+	 * relative to the start of a stretch of lines, so that adding or
+	 * removing a line only has to renumber the lines up to the next
+	 * stretch, and then the stretches after it. */
 	struct filestruct *next;
 	/* Next node. */
 	struct filestruct *prev;
 	/* Previous node. */
-	std::vector<short> multidata;
-	/* Array of which multi-line regexes apply to this line */
+	widthcache *widths = nullptr;
+	/* The display widths of this line, if it's a long one. */
+	linecolors *highlight = nullptr;
+	/* The cached highlighting of this line, if it has been worked out. */
+
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
+	/* Nodes are carved out of slabs instead of allocated one by one. */
 } filestruct;
 
 typedef struct partition {
@@ -90,6 +180,11 @@ typedef struct undo {
 	/* copy copy copy */
 	size_t mark_begin_x;
 	/* Another shadow variable */
+	size_t same_front, same_back;
+	/* For a replace, how many bytes at the start and the end of the line
+	 * it left alone; strdata holds only what was between them */
+	size_t size;
+	/* How many bytes this item took up when it was last counted */
 	struct undo *next;
 } undo;
 
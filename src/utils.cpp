@@ -161,17 +161,6 @@ void sunder(std::string& str)
 	std::replace(str.begin(), str.end(), '\n', '\0');
 }
 
-void sunder(char *str)
-{
-	assert(str != NULL);
-
-	for (; *str != '\0'; str++) {
-		if (*str == '\n') {
-			*str = '\0';
-		}
-	}
-}
-
 /* These functions, ngetline() (originally getline()) and ngetdelim()
  * (originally getdelim()), were adapted from GNU mailutils 0.5
  * (mailbox/getline.c).  Here is the notice from that file, after
@@ -354,18 +343,7 @@ const char *strstrwrapper(const char *haystack, const char *needle, const char *
 
 	if (ISSET(USE_REGEXP)) {
 		if (ISSET(BACKWARDS_SEARCH)) {
-			if (regexec(&search_regexp, haystack, 1, regmatches, 0) == 0 && haystack + regmatches[0].rm_so <= start) {
-				const char *retval = haystack + regmatches[0].rm_so;
-
-				/* Search forward until there are no more matches. */
-				while (regexec(&search_regexp, retval + 1, 1, regmatches, REG_NOTBOL) == 0 && retval + regmatches[0].rm_so + 1 <= start) {
-					retval += regmatches[0].rm_so + 1;
-				}
-				/* Finally, put the subexpression matches in global variable
-				 * regmatches.  The REG_NOTBOL flag doesn't matter now. */
-				regexec(&search_regexp, retval, 10, regmatches, 0);
-				return retval;
-			}
+			return last_regex_match(haystack, start);
 		} else if (regexec(&search_regexp, start, 10, regmatches, (start > haystack) ? REG_NOTBOL : 0) == 0) {
 			const char *retval = start + regmatches[0].rm_so;
 
@@ -374,16 +352,51 @@ const char *strstrwrapper(const char *haystack, const char *needle, const char *
 		}
 		return NULL;
 	}
-	if (ISSET(CASE_SENSITIVE)) {
-		if (ISSET(BACKWARDS_SEARCH)) {
-			return revstrstr(haystack, needle, start);
-		} else {
-			return strstr(start, needle);
+
+	/* Searches go through one line after another looking for the same
+	 * string, so keep the prepared needle around until it changes. */
+	static LiteralSearch *literal = NULL;
+
+	if (literal == NULL || !literal->is_for(needle, ISSET(CASE_SENSITIVE))) {
+		delete literal;
+		literal = new LiteralSearch(needle, ISSET(CASE_SENSITIVE));
+	}
+
+	if (ISSET(BACKWARDS_SEARCH)) {
+		return literal->rfind(haystack, start);
+	}
+	return literal->find(start);
+}
+
+/* Return the last place at or before start in haystack where the search
+ * regex matches, or NULL if there is none, and put the subexpression
+ * matches in regmatches.  Each match after the first is looked for from
+ * one byte past the previous one.  The length of the line is given to
+ * regexec() with REG_STARTEND where that exists, so that it doesn't
+ * measure the rest of the line again for every match. */
+const char *last_regex_match(const char *haystack, const char *start)
+{
+	size_t len = strlen(haystack), from = 0, limit = start - haystack;
+	const char *found = NULL;
+	regmatch_t match;
+
+	while (from <= limit) {
+		match.rm_so = 0;
+		match.rm_eo = len - from;
+
+		if (regexec(&search_regexp, haystack + from, 1, &match, ((from > 0) ? REG_NOTBOL : 0) | REG_STARTEND) != 0 || from + match.rm_so > limit) {
+			break;
 		}
-	} else if (ISSET(BACKWARDS_SEARCH)) {
-		return mbrevstrcasestr(haystack, needle, start);
+
+		found = haystack + from + match.rm_so;
+		from += match.rm_so + 1;
+	}
+
+	if (found != NULL) {
+		regexec(&search_regexp, found, 10, regmatches, 0);
 	}
-	return mbstrcasestr(start, needle);
+
+	return found;
 }
 
 /* This is a wrapper for the perror() function.  The wrapper temporarily
@@ -471,7 +484,7 @@ size_t get_page_start(size_t column)
 size_t xplustabs(void)
 {
 	if (openfile->current) {
-		return strnlenpt(openfile->current->data, openfile->current_x);
+		return line_strnlenpt(openfile->current, openfile->current_x);
 	} else {
 		return 0;
 	}
@@ -481,15 +494,35 @@ size_t xplustabs(void)
  * i.e. the largest value such that strnlenpt(s, actual_x(s, column)) <=
  * column. */
 size_t actual_x(const char *s, size_t column)
+{
+	return actual_x_from(s, column, 0);
+}
+
+/* The same as actual_x(), for the part of a line that starts at s and
+ * is displayed from column len on, where len is no more than column. */
+size_t actual_x_from(const char *s, size_t column, size_t len)
 {
 	size_t i = 0;
 	/* The position in s, returned. */
-	size_t len = 0;
-	/* The screen display width to s[i]. */
 
-	assert(s != NULL);
+	assert(s != NULL && len <= column);
 
 	while (*s != '\0') {
+		/* Take a run of plain ASCII characters in one go: each of them
+		 * is one column wide. */
+		size_t run = printable_ascii_len(s);
+
+		if (run > 0) {
+			if (len + run > column) {
+				return i + (column - len);
+			}
+
+			i += run;
+			s += run;
+			len += run;
+			continue;
+		}
+
 		int s_len = parse_mbchar(s, NULL, &len);
 
 		if (len > column) {
@@ -508,16 +541,36 @@ size_t actual_x(const char *s, size_t column)
  * of s? */
 size_t strnlenpt(const char *s, size_t maxlen)
 {
-	size_t len = 0;
-	/* The screen display width to s[i]. */
+	return strnlenpt_from(s, maxlen, 0);
+}
 
+/* The same as strnlenpt(), for the part of a line that starts at s and
+ * is displayed from column len on.  Return the column where the first
+ * maxlen characters of s end. */
+size_t strnlenpt_from(const char *s, size_t maxlen, size_t len)
+{
 	if (maxlen == 0) {
-		return 0;
+		return len;
 	}
 
 	assert(s != NULL);
 
 	while (*s != '\0') {
+		/* Take a run of plain ASCII characters in one go: each of them
+		 * is one byte long and one column wide. */
+		size_t run = std::min(printable_ascii_len(s), maxlen);
+
+		if (run > 0) {
+			len += run;
+			s += run;
+			maxlen -= run;
+
+			if (maxlen == 0) {
+				break;
+			}
+			continue;
+		}
+
 		int s_len = parse_mbchar(s, NULL, &len);
 
 		s += s_len;
@@ -539,6 +592,162 @@ size_t strlenpt(const char *s)
 	return strnlenpt(s, (size_t)-1);
 }
 
+/* Return the width cache of the given line, bringing it up to date
+ * first if the line or tabsize has changed since it was filled in.
+ * Short lines don't get one, since measuring them is cheap anyway; for
+ * them, return NULL. */
+widthcache *line_widths(filestruct *fileptr)
+{
+	const char *s = fileptr->data;
+	size_t len = strlen(s);
+	widthcache *cache = fileptr->widths;
+	size_t i = 0, col = 0;
+
+	if (len < WIDTH_CACHE_MIN) {
+		return NULL;
+	}
+
+	if (cache == NULL) {
+		cache = fileptr->widths = new widthcache;
+	} else if (cache->data == s && cache->len == len && cache->tabsize == tabsize) {
+		return cache;
+	}
+
+	cache->data = s;
+	cache->len = len;
+	cache->tabsize = tabsize;
+	cache->marks.clear();
+
+	/* Note the column at the first character boundary at or after every
+	 * WIDTH_INDEX_STRIDE bytes. */
+	while (s[i] != '\0') {
+		size_t next_mark = (cache->marks.size() + 1) * WIDTH_INDEX_STRIDE;
+		size_t run;
+
+		if (i >= next_mark) {
+			cache->marks.push_back(std::make_pair(i, col));
+			continue;
+		}
+
+		run = std::min(printable_ascii_len(s + i), next_mark - i);
+
+		if (run > 0) {
+			i += run;
+			col += run;
+		} else {
+			i += parse_mbchar(s + i, NULL, &col);
+		}
+	}
+
+	cache->width = col;
+
+	return cache;
+}
+
+/* Mark the width cache of the given line as out of date, since the text
+ * of the line has been changed. */
+void forget_widths(filestruct *fileptr)
+{
+	if (fileptr->widths != NULL) {
+		fileptr->widths->data = NULL;
+	}
+}
+
+/* strlenpt() for the text of the given line, using its width cache. */
+size_t line_strlenpt(filestruct *fileptr)
+{
+	widthcache *cache = line_widths(fileptr);
+
+	return (cache != NULL) ? cache->width : strlenpt(fileptr->data);
+}
+
+/* strnlenpt() for the text of the given line: start measuring from the
+ * last indexed character boundary at or before maxlen. */
+size_t line_strnlenpt(filestruct *fileptr, size_t maxlen)
+{
+	widthcache *cache = line_widths(fileptr);
+	std::vector<std::pair<size_t, size_t> >::const_iterator mark;
+
+	if (cache == NULL) {
+		return strnlenpt(fileptr->data, maxlen);
+	} else if (maxlen >= cache->len) {
+		return cache->width;
+	}
+
+	/* Find the first mark past maxlen, and step back to the one before
+	 * it, if there is one. */
+	mark = std::upper_bound(cache->marks.begin(), cache->marks.end(), maxlen, [](size_t x, const std::pair<size_t, size_t>& m) {
+		return x < m.first;
+	});
+
+	if (mark == cache->marks.begin()) {
+		return strnlenpt(fileptr->data, maxlen);
+	}
+
+	--mark;
+
+	return strnlenpt_from(fileptr->data + mark->first, maxlen - mark->first, mark->second);
+}
+
+/* actual_x() for the text of the given line: start looking from the
+ * last indexed character boundary displayed at or before column. */
+size_t line_actual_x(filestruct *fileptr, size_t column)
+{
+	widthcache *cache = line_widths(fileptr);
+	std::vector<std::pair<size_t, size_t> >::const_iterator mark;
+
+	if (cache == NULL) {
+		return actual_x(fileptr->data, column);
+	} else if (column >= cache->width) {
+		return cache->len;
+	}
+
+	/* Find the first mark past column, and step back to the one before
+	 * it, if there is one. */
+	mark = std::upper_bound(cache->marks.begin(), cache->marks.end(), column, [](size_t col, const std::pair<size_t, size_t>& m) {
+		return col < m.second;
+	});
+
+	if (mark == cache->marks.begin()) {
+		return actual_x(fileptr->data, column);
+	}
+
+	--mark;
+
+	return mark->first + actual_x_from(fileptr->data + mark->first, column, mark->second);
+}
+
+/* Get the line with number lineno in the current open file, or the last
+ * line if the file doesn't have that many. */
+filestruct *line_from_number(ssize_t lineno)
+{
+	filestruct *f;
+
+	if (lineno >= openfile->filebot->lineno) {
+		return openfile->filebot;
+	}
+
+	/* Don't start from the current line, since it may just have been
+	 * deleted; start from the start of the nearest stretch of lines. */
+	if (filepart == NULL && lineno > 0) {
+		for (f = indexed_line(lineno); f->lineno < lineno && f != openfile->filebot; f = f->next) {
+			;
+		}
+
+		if (f->lineno == lineno) {
+			return f;
+		}
+	}
+
+	/* If no line has that number, because the lines haven't been
+	 * renumbered yet after an edit, count the lines from the top. */
+	for (f = openfile->fileage; f != openfile->filebot && lineno > 1; lineno--) {
+		f = f->next;
+	}
+
+	return f;
+}
+
 /* Append a new magicline to filebot. */
 void new_magicline(void)
 {
@@ -546,8 +755,8 @@ void new_magicline(void)
 	openfile->filebot->next->data = mallocstrcpy(NULL, "");
 	openfile->filebot->next->prev = openfile->filebot;
 	openfile->filebot->next->next = NULL;
-	openfile->filebot->next->lineno = openfile->filebot->lineno + 1;
 	openfile->filebot = openfile->filebot->next;
+	renumber(openfile->filebot);
 	openfile->totsize++;
 }
 
@@ -601,7 +810,7 @@ size_t get_totsize(const filestruct *begin, const filestruct *end)
 	const filestruct *f;
 
 	/* Go through the lines from begin to end->prev, if we can. */
-	for (f = begin; f != end && f != NULL; f = f->next) {
+	for (f = begin; f != end && f != NULL; f = next_line(f)) {
 		/* Count the number of characters on this line. */
 		totsize += mbstrlen(f->data);
 
@@ -625,12 +834,52 @@ size_t get_totsize(const filestruct *begin, const filestruct *end)
 	return totsize;
 }
 
+/* Count the words in the lines from begin to end, the way "wc -w" does:
+ * a word is a run of word characters, punctuation characters included. */
+size_t count_words(const filestruct *begin, const filestruct *end)
+{
+	size_t words = 0;
+	char *char_mb = charalloc(mb_cur_max());
+	const filestruct *f;
+
+	for (f = begin; f != NULL; f = next_line(f)) {
+		const char *ptr = f->data;
+		bool in_word = false;
+
+		while (*ptr != '\0') {
+			int char_mb_len = parse_mbchar(ptr, char_mb, NULL);
+			bool is_word = is_word_mbchar(char_mb, true);
+
+			if (is_word && !in_word) {
+				words++;
+			}
+
+			in_word = is_word;
+			ptr += char_mb_len;
+		}
+
+		if (f == end) {
+			break;
+		}
+	}
+
+	free(char_mb);
+
+	return words;
+}
+
 /* Get back a pointer given a line number in the current open file */
 filestruct *fsfromline(ssize_t lineno)
 {
 	filestruct *f = openfile->current;
 
-	if (lineno <= openfile->current->lineno)
+	/* If the line is far away from the current one, start looking from
+	 * the start of the nearest stretch of lines instead. */
+	if (filepart == NULL && lineno > 0 && (lineno > f->lineno + LINE_INDEX_STRIDE || lineno < f->lineno - LINE_INDEX_STRIDE)) {
+		f = indexed_line(lineno);
+	}
+
+	if (lineno <= f->lineno)
 		for (; f->lineno != lineno && f != openfile->fileage; f = f->prev) {
 			;
 		}
@@ -185,8 +185,40 @@ char *display_string(const char *buf, size_t start_col, size_t len, bool dollars
 {
 	size_t start_index;
 	/* Index in buf of the first character shown. */
-	size_t column;
-	/* Screen column that start_index corresponds to. */
+
+	/* If dollars is true, make room for the "$" at the end of the
+	 * line. */
+	if (dollars && len > 0 && strlenpt(buf) > start_col + len) {
+		len--;
+	}
+
+	start_index = actual_x(buf, start_col);
+
+	return display_string_from(buf, start_index, strnlenpt(buf, start_index), start_col, len, dollars);
+}
+
+/* The same as display_string(), for the text of a line, measured with
+ * the help of its width cache. */
+char *display_string(filestruct *fileptr, size_t start_col, size_t len, bool dollars)
+{
+	size_t start_index;
+
+	if (dollars && len > 0 && line_strlenpt(fileptr) > start_col + len) {
+		len--;
+	}
+
+	start_index = line_actual_x(fileptr, start_col);
+
+	return display_string_from(fileptr->data, start_index, line_strnlenpt(fileptr, start_index), start_col, len, dollars);
+}
+
+/* Do the work of display_string(), given the index in buf of the first
+ * character shown and the screen column that it corresponds to.  We
+ * stop expanding buf once we're past the len columns we return. */
+char *display_string_from(const char *buf, size_t start_index, size_t column, size_t start_col, size_t len, bool dollars)
+{
+	size_t end_col = start_col + len;
+	/* The screen column after the last one shown. */
 	size_t alloc_len;
 	/* The length of memory allocated for converted. */
 	char *converted;
@@ -196,20 +228,11 @@ char *display_string(const char *buf, size_t start_col, size_t len, bool dollars
 	char *buf_mb;
 	int buf_mb_len;
 
-	/* If dollars is true, make room for the "$" at the end of the
-	 * line. */
-	if (dollars && len > 0 && strlenpt(buf) > start_col + len) {
-		len--;
-	}
-
 	if (len == 0) {
 		return mallocstrcpy(NULL, "");
 	}
 
-	buf_mb = charalloc(mb_cur_max());
-
-	start_index = actual_x(buf, start_col);
-	column = strnlenpt(buf, start_index);
+	buf_mb = charalloc(mb_cur_max() + 1);
 
 	assert(column <= start_col);
 
@@ -266,7 +289,7 @@ char *display_string(const char *buf, size_t start_col, size_t len, bool dollars
 		}
 	}
 
-	while (buf[start_index] != '\0') {
+	while (buf[start_index] != '\0' && start_col <= end_col) {
 		buf_mb_len = parse_mbchar(buf + start_index, buf_mb, NULL);
 
 		/* Make sure there's enough room for the next character, whether
@@ -331,7 +354,7 @@ char *display_string(const char *buf, size_t start_col, size_t len, bool dollars
 			/* Make sure an invalid sequence-starter byte is properly
 			 * terminated, so that it doesn't pick up lingering bytes
 			 * of any previous content. */
-			null_at(&buf_mb, buf_mb_len);
+			buf_mb[buf_mb_len] = '\0';
 
 			nctrl_buf_mb = mbrep(buf_mb, nctrl_buf_mb, &nctrl_buf_mb_len);
 
@@ -540,6 +563,15 @@ the_end:
  * update the titlebar to display the file's new status. */
 void set_modified(void)
 {
+	/* Any change can add or remove words, and change the highlighting
+	 * from the changed line on. */
+	openfile->wordcount_valid = false;
+	text_changes++;
+	reset_multis(openfile->current->lineno);
+	if (openfile->mark_set) {
+		reset_multis(openfile->mark_begin->lineno);
+	}
+
 	if (!openfile->modified) {
 		openfile->modified = true;
 		titlebar(NULL);
@@ -723,7 +755,7 @@ void reset_cursor(void)
 		openfile->current_y = 0;
 
 		for (tmp = openfile->edittop; tmp && tmp != openfile->current; tmp = tmp->next) {
-			openfile->current_y += 1 + strlenpt(tmp->data) / COLS;
+			openfile->current_y += 1 + line_strlenpt(tmp) / COLS;
 		}
 
 		openfile->current_y += xplustabs() / COLS;
@@ -756,10 +788,10 @@ void unset_formatting(ColorPtr color)
  * line. */
 void edit_draw(filestruct *fileptr, const char *converted, int line, size_t start)
 {
-	size_t startpos = actual_x(fileptr->data, start);
+	size_t startpos = line_actual_x(fileptr, start);
 	/* The position in fileptr->data of the leftmost character
 	 * that displays at least partially on the window. */
-	size_t endpos = actual_x(fileptr->data, start + COLS - 1) + 1;
+	size_t endpos = line_actual_x(fileptr, start + COLS - 1) + 1;
 	/* The position in fileptr->data of the first character that is
 	 * completely off the window to the right.
 	 *
@@ -780,24 +812,25 @@ void edit_draw(filestruct *fileptr, const char *converted, int line, size_t star
 #endif
 
 	/* If color syntaxes are available and turned on, we need to display
-	 * them. */
+	 * them.  Which stretches of the line each color paints is worked out
+	 * once, and kept until the line changes. */
 	if (!openfile->colorstrings.empty() && !ISSET(NO_COLOR_SYNTAX)) {
-		/* Set up multi-line color data for this line if it's not yet calculated  */
-		if (fileptr->multidata.empty() && openfile->syntax && openfile->syntax->nmultis > 0) {
-			fileptr->multidata.resize(openfile->syntax->nmultis, -1); // assume that '-1' applies until we know otherwise
-		}
+		const linecolors *colors = highlight_line(fileptr, endpos);
+		size_t i = 0;
+
 		for (auto tmpcolor : openfile->colorstrings) {
+			const colorspans *found = &colors->colors[i];
+			bool open_end = (colors->state[i] & MULTI_OPEN_AFTER);
+			/* Whether the last stretch is a multi-line match that goes
+			 * on past the end of this line. */
 			int x_start;
 			/* Starting column for mvwaddnstr.  Zero-based. */
-			int paintlen = 0;
+			int paintlen;
 			/* Number of chars to paint on this line.  There are
 			 * COLS characters on a whole line. */
 			size_t index;
 			/* Index in converted where we paint. */
-			regmatch_t startmatch;
-			/* Match position for start_regex. */
-			regmatch_t endmatch;
-			/* Match position for end_regex. */
+			size_t n;
 
 			if (tmpcolor->bright) {
 				wattron(edit, A_BOLD);
@@ -806,226 +839,65 @@ void edit_draw(filestruct *fileptr, const char *converted, int line, size_t star
 				wattron(edit, A_UNDERLINE);
 			}
 			wattron(edit, COLOR_PAIR(tmpcolor->pairnum));
-			/* Two notes about regexec().  A return value of zero means
-			 * that there is a match.  Also, rm_eo is the first
-			 * non-matching character after the match. */
-
-			/* First case,tmpcolor is a single-line expression. */
-			if (tmpcolor->end == NULL) {
-				size_t k = 0;
-
-				/* We increment k by rm_eo, to move past the end of the
-				 * last match.  Even though two matches may overlap, we
-				 * want to ignore them, so that we can highlight e.g. C
-				 * strings correctly. */
-				while (k < endpos) {
-					/* Note the fifth parameter to regexec().  It says
-					 * not to match the beginning-of-line character
-					 * unless k is zero.  If regexec() returns
-					 * REG_NOMATCH, there are no more matches in the
-					 * line. */
-					if (regexec(tmpcolor->start, &fileptr->data[k], 1, &startmatch, (k == 0) ? 0 : REG_NOTBOL) == REG_NOMATCH) {
-						break;
-					}
-
-
-					/* Translate the match to the beginning of the
-					 * line. */
-					startmatch.rm_so += k;
-					startmatch.rm_eo += k;
-
-					/* Skip over a zero-length regex match. */
-					if (startmatch.rm_so == startmatch.rm_eo) {
-						startmatch.rm_eo++;
-					} else if (startmatch.rm_so < endpos && startmatch.rm_eo > startpos) {
-						x_start = (startmatch.rm_so <= startpos) ? 0 : strnlenpt(fileptr->data, startmatch.rm_so) - start;
-
-						index = actual_x(converted, x_start);
-
-						paintlen = actual_x(converted + index, strnlenpt(fileptr->data, startmatch.rm_eo) - start - x_start);
-
-						assert(0 <= x_start && 0 <= paintlen);
-
-						mvwaddnstr(edit, line, x_start, converted + index, paintlen);
-					}
-					k = startmatch.rm_eo;
-				}
-			} else if (!fileptr->multidata.empty() && fileptr->multidata[tmpcolor->id] != CNONE) {
-				/* This is a multi-line regex.  There are two steps.
-				 * First, we have to see if the beginning of the line is
-				 * colored by a start on an earlier line, and an end on
-				 * this line or later.
-				 *
-				 * We find the first line before fileptr matching the
-				 * start.  If every match on that line is followed by an
-				 * end, then go to step two.  Otherwise, find the next
-				 * line after start_line matching the end.  If that line
-				 * is not before fileptr, then paint the beginning of
-				 * this line. */
-				const filestruct *start_line = fileptr->prev;
-				/* The first line before fileptr matching start. */
-				regoff_t start_col;
-				/* Where it starts in that line. */
-				const filestruct *end_line;
-				short md = fileptr->multidata[tmpcolor->id];
-
-				if (md == -1) {
-					fileptr->multidata[tmpcolor->id] = CNONE;    /* until we find out otherwise */
-				} else if (md == CNONE) {
-					unset_formatting(tmpcolor);
-					continue;
-				} else if (md == CWHOLELINE) {
-					mvwaddnstr(edit, line, 0, converted, -1);
-					unset_formatting(tmpcolor);
-					continue;
-				} else if (md == CBEGINBEFORE) {
-					regexec(tmpcolor->end, fileptr->data, 1, &endmatch, 0);
-					paintlen = actual_x(converted, strnlenpt(fileptr->data, endmatch.rm_eo) - start);
-					mvwaddnstr(edit, line, 0, converted, paintlen);
-					unset_formatting(tmpcolor);
+
+			for (n = 0; n < found->spans.size() && found->spans[n].first < endpos; n++) {
+				size_t span_start = found->spans[n].first, span_end = found->spans[n].second;
+
+				if (span_end <= startpos || span_start == span_end) {
 					continue;
 				}
 
-				while (start_line != NULL && regexec(tmpcolor->start, start_line->data, 1, &startmatch, 0) == REG_NOMATCH) {
-					/* If there is an end on this line, there is no need
-					 * to look for starts on earlier lines. */
-					if (regexec(tmpcolor->end, start_line->data, 0, NULL, 0) == 0) {
-						goto step_two;
-					}
-					start_line = start_line->prev;
+				/* Don't paint a start that isn't followed by an end. */
+				if (open_end && n == found->spans.size() - 1 && !multi_ends_later(fileptr, i, tmpcolor)) {
+					break;
 				}
 
-				/* If the found start has been qualified as an end earlier, believe it and skip to the next step. */
-				if (start_line != NULL && !start_line->multidata.empty() && start_line->multidata[tmpcolor->id] == CBEGINBEFORE) {
-					goto step_two;
-				}
+				x_start = (span_start <= startpos) ? 0 : line_strnlenpt(fileptr, span_start) - start;
 
-				/* Skip over a zero-length regex match. */
-				if (startmatch.rm_so == startmatch.rm_eo) {
-					startmatch.rm_eo++;
-				} else {
-					/* No start found, so skip to the next step. */
-					if (start_line == NULL) {
-						goto step_two;
-					}
-					/* Now start_line is the first line before fileptr
-					 * containing a start match.  Is there a start on
-					 * this line not followed by an end on this line? */
-					start_col = 0;
-					while (true) {
-						start_col += startmatch.rm_so;
-						startmatch.rm_eo -= startmatch.rm_so;
-						if (regexec(tmpcolor->end, start_line->data + start_col + startmatch.rm_eo, 0, NULL, (start_col + startmatch.rm_eo == 0) ? 0 : REG_NOTBOL) == REG_NOMATCH) {
-							/* No end found after this start. */
-							break;
-						}
-						start_col++;
-						if (regexec(tmpcolor->start, start_line->data + start_col, 1, &startmatch, REG_NOTBOL) == REG_NOMATCH) {
-							/* No later start on this line. */
-							goto step_two;
-						}
-					}
-					/* Indeed, there is a start not followed on this
-					 * line by an end. */
-
-					/* We have already checked that there is no end
-					 * before fileptr and after the start.  Is there an
-					 * end after the start at all?  We don't paint
-					 * unterminated starts. */
-					end_line = fileptr;
-					while (end_line != NULL && regexec(tmpcolor->end, end_line->data, 1, &endmatch, 0) == REG_NOMATCH) {
-						end_line = end_line->next;
-					}
-
-					/* No end found, or it is too early. */
-					if (end_line == NULL || (end_line == fileptr && endmatch.rm_eo <= startpos)) {
-						goto step_two;
-					}
-
-					/* Now paint the start of fileptr.  If the start of
-					 * fileptr is on a different line from the end,
-					 * paintlen is -1, meaning that everything on the
-					 * line gets painted.  Otherwise, paintlen is the
-					 * expanded location of the end of the match minus
-					 * the expanded location of the beginning of the
-					 * page. */
-					if (end_line != fileptr) {
-						paintlen = -1;
-						fileptr->multidata[tmpcolor->id] = CWHOLELINE;
-					} else {
-						paintlen = actual_x(converted, strnlenpt(fileptr->data, endmatch.rm_eo) - start);
-						fileptr->multidata[tmpcolor->id] = CBEGINBEFORE;
-					}
-					mvwaddnstr(edit, line, 0, converted, paintlen);
-					/* If the whole line has been painted, don't bother looking for any more starts. */
-					if (paintlen < 0) {
-						continue;
-					}
-step_two:
-					/* Second step, we look for starts on this line. */
-					start_col = 0;
-
-					while (start_col < endpos) {
-						if (regexec(tmpcolor->start, fileptr->data + start_col, 1, &startmatch, (start_col == 0) ? 0 : REG_NOTBOL) == REG_NOMATCH || start_col + startmatch.rm_so >= endpos) {
-							/* No more starts on this line. */
-							break;
-						}
-						/* Translate the match to be relative to the
-						 * beginning of the line. */
-						startmatch.rm_so += start_col;
-						startmatch.rm_eo += start_col;
-
-						x_start = (startmatch.rm_so <= startpos) ? 0 : strnlenpt(fileptr->data, startmatch.rm_so) - start;
-
-						index = actual_x(converted, x_start);
-
-						if (regexec(tmpcolor->end, fileptr->data + startmatch.rm_eo, 1, &endmatch, (startmatch.rm_eo == 0) ? 0 : REG_NOTBOL) == 0) {
-							/* Translate the end match to be relative to the beginning of the line. */
-							endmatch.rm_so += startmatch.rm_eo;
-							endmatch.rm_eo += startmatch.rm_eo;
-							/* There is an end on this line.  But does
-							 * it appear on this page, and is the match
-							 * more than zero characters long? */
-							if (endmatch.rm_eo > startpos && endmatch.rm_eo > startmatch.rm_so) {
-								paintlen = actual_x(converted + index, strnlenpt(fileptr->data, endmatch.rm_eo) - start - x_start);
-
-								assert(0 <= x_start && x_start < COLS);
-
-								mvwaddnstr(edit, line, x_start, converted + index, paintlen);
-								if (paintlen > 0) {
-									fileptr->multidata[tmpcolor->id] = CSTARTENDHERE;
-								}
-
-							}
-						} else {
-							/* There is no end on this line.  But we
-							 * haven't yet looked for one on later
-							 * lines. */
-							end_line = fileptr->next;
-
-							while (end_line != NULL && regexec(tmpcolor->end, end_line->data, 0, NULL, 0) == REG_NOMATCH) {
-								end_line = end_line->next;
-							}
-
-							if (end_line != NULL) {
-								assert(0 <= x_start && x_start < COLS);
-
-								mvwaddnstr(edit, line, x_start, converted + index, -1);
-								/* We painted to the end of the line, so
-								 * don't bother checking any more
-								 * starts. */
-								fileptr->multidata[tmpcolor->id] = CENDAFTER;
-								break;
-							}
-						}
-						start_col = startmatch.rm_so + 1;
-					}
-				}
+				index = actual_x(converted, x_start);
+
+				paintlen = actual_x(converted + index, line_strnlenpt(fileptr, span_end) - start - x_start);
+
+				assert(0 <= x_start && 0 <= paintlen);
+
+				mvwaddnstr(edit, line, x_start, converted + index, paintlen);
 			}
+
 			unset_formatting(tmpcolor);
+			i++;
 		}
 	}
 
+	/* If all matches of the last search are to be shown, and the index of
+	 * them is up to date, paint the ones on this part of the line. */
+	if (ISSET(HIGHLIGHT_MATCHES) && filepart == NULL && openfile->matches != NULL &&
+	        openfile->matches->complete() && openfile->matches->is_current()) {
+		const MatchIndex *index = openfile->matches;
+		size_t n = index->first_on_line(fileptr->lineno);
+
+		wattron(edit, highlight_attribute);
+
+		for (; n < index->count() && index->line(n) == fileptr->lineno && index->start(n) < endpos; n++) {
+			size_t match_start = index->start(n), match_end = match_start + index->length(n);
+			int x_start, paintlen;
+			size_t x;
+
+			if (match_end <= startpos || match_start == match_end) {
+				continue;
+			}
+
+			x_start = (match_start <= startpos) ? 0 : line_strnlenpt(fileptr, match_start) - start;
+
+			x = actual_x(converted, x_start);
+
+			paintlen = actual_x(converted + x, line_strnlenpt(fileptr, match_end) - start - x_start);
+
+			mvwaddnstr(edit, line, x_start, converted + x, paintlen);
+		}
+
+		wattroff(edit, highlight_attribute);
+	}
+
 	/* If the mark is on, we need to display it. */
 	if (openfile->mark_set && (fileptr->lineno <=
 	                           openfile->mark_begin->lineno || fileptr->lineno <=
@@ -1062,7 +934,7 @@ step_two:
 
 			/* x_start is the expanded location of the beginning of the
 			 * mark minus the beginning of the page. */
-			x_start = strnlenpt(fileptr->data, top_x) - start;
+			x_start = line_strnlenpt(fileptr, top_x) - start;
 
 			/* If the end of the mark is off the page, paintlen is -1,
 			 * meaning that everything on the line gets painted.
@@ -1072,7 +944,7 @@ step_two:
 			if (bot_x >= endpos) {
 				paintlen = -1;
 			} else
-				paintlen = strnlenpt(fileptr->data, bot_x) - (x_start + start);
+				paintlen = line_strnlenpt(fileptr, bot_x) - (x_start + start);
 
 			/* If x_start is before the beginning of the page, shift
 			 * paintlen x_start characters to compensate, and put
@@ -1117,7 +989,7 @@ int update_line(filestruct *fileptr, size_t index)
 
 	if (ISSET(SOFTWRAP)) {
 		for (tmp = openfile->edittop; tmp && tmp != fileptr; tmp = tmp->next) {
-			line += 1 + (strlenpt(tmp->data) / COLS);
+			line += 1 + (line_strlenpt(tmp) / COLS);
 		}
 	} else {
 		line = fileptr->lineno - openfile->edittop->lineno;
@@ -1135,13 +1007,13 @@ int update_line(filestruct *fileptr, size_t index)
 	if (ISSET(SOFTWRAP)) {
 		index = 0;
 	} else {
-		index = strnlenpt(fileptr->data, index);
+		index = line_strnlenpt(fileptr, index);
 	}
 	page_start = get_page_start(index);
 
 	/* Expand the line, replacing tabs with spaces, and control
 	 * characters with their displayed forms. */
-	converted = display_string(fileptr->data, page_start, COLS, !ISSET(SOFTWRAP));
+	converted = display_string(fileptr, page_start, COLS, !ISSET(SOFTWRAP));
 
 #ifdef DEBUG
 	if (ISSET(SOFTWRAP) && strlen(converted) >= COLS - 2) {
@@ -1158,11 +1030,11 @@ int update_line(filestruct *fileptr, size_t index)
 		if (page_start > 0) {
 			mvwaddch(edit, line, 0, '$');
 		}
-		if (strlenpt(fileptr->data) > page_start + COLS) {
+		if (line_strlenpt(fileptr) > page_start + COLS) {
 			mvwaddch(edit, line, COLS - 1, '$');
 		}
 	} else {
-		int full_length = strlenpt(fileptr->data);
+		int full_length = line_strlenpt(fileptr);
 		for (index += COLS; index <= full_length && line < editwinrows; index += COLS) {
 			line++;
 			DEBUG_LOG("update_line(): Softwrap code, moving to " << line << " index " << index);
@@ -1170,7 +1042,7 @@ int update_line(filestruct *fileptr, size_t index)
 
 			/* Expand the line, replacing tabs with spaces, and control
 			 * characters with their displayed forms. */
-			converted = display_string(fileptr->data, index, COLS, !ISSET(SOFTWRAP));
+			converted = display_string(fileptr, index, COLS, !ISSET(SOFTWRAP));
 			if (ISSET(SOFTWRAP) && strlen(converted) >= COLS - 2) {
 				DEBUG_LOG("update_line(): converted(2) line == " << converted);
 			}
@@ -1208,7 +1080,7 @@ void compute_maxrows(void)
 	maxrows = 0;
 	for (n = 0; n < editwinrows && foo; n++) {
 		maxrows ++;
-		n += strlenpt(foo->data) / COLS;
+		n += line_strlenpt(foo) / COLS;
 		foo = foo->next;
 	}
 
@@ -1256,7 +1128,7 @@ void edit_scroll(ScrollDir direction, ssize_t nlines)
 		}
 		/* Don't over-scroll on long lines */
 		if (ISSET(SOFTWRAP) && (direction == UPWARD)) {
-			ssize_t len = strlenpt(openfile->edittop->data) / COLS;
+			ssize_t len = line_strlenpt(openfile->edittop) / COLS;
 			i -= len;
 			if (len > 0) {
 				do_redraw = true;
@@ -1481,7 +1353,7 @@ void edit_update(UpdateType location)
 	for (; goal > 0 && foo->prev != NULL; goal--) {
 		foo = foo->prev;
 		if (ISSET(SOFTWRAP) && foo) {
-			goal -= strlenpt(foo->data) / COLS;
+			goal -= line_strlenpt(foo) / COLS;
 		}
 	}
 	openfile->edittop = foo;
@@ -1533,24 +1405,18 @@ void display_main_list(void)
  * display the current cursor position next time. */
 void do_cursorpos(bool constant)
 {
-	filestruct *f;
-	char c;
-	size_t i, cur_xpt = xplustabs() + 1;
-	size_t cur_lenpt = strlenpt(openfile->current->data) + 1;
+	size_t i, x, cur_xpt = xplustabs() + 1;
+	size_t cur_lenpt = line_strlenpt(openfile->current) + 1;
 	int linepct, colpct, charpct;
 
 	assert(openfile->fileage != NULL && openfile->current != NULL);
 
-	f = openfile->current->next;
-	c = openfile->current->data[openfile->current_x];
-
-	openfile->current->next = NULL;
-	openfile->current->data[openfile->current_x] = '\0';
-
-	i = get_totsize(openfile->fileage, openfile->current);
-
-	openfile->current->data[openfile->current_x] = c;
-	openfile->current->next = f;
+	/* Count the characters before the cursor without cutting the buffer
+	 * short there, since a background scan may be reading it. */
+	i = (openfile->current == openfile->fileage) ? 0 : get_totsize(openfile->fileage, openfile->current->prev);
+	for (x = 0; x < openfile->current_x; x = move_mbright(openfile->current->data, x)) {
+		i++;
+	}
 
 	if (constant && disable_cursorpos) {
 		disable_cursorpos = false;